@@ -1,54 +1,486 @@
 /*
- * Programa demostrativo de manipulaciónprocesamiento de imágenes BMP en C++ usando Qt.
+ * Programa de recuperación de imágenes BMP transformadas a nivel de bits, en C++ usando Qt.
  *
  * Descripción:
- * Este programa realiza las siguientes tareas:
- * 1. Carga una imagen BMP desde un archivo (formato RGB sin usar estructuras ni STL).
- * 2. Modifica los valores RGB de los píxeles asignando un degradado artificial basado en su posición.
- * 3. Exporta la imagen modificada a un nuevo archivo BMP.
- * 4. Carga un archivo de texto que contiene una semilla (offset) y los resultados del enmascaramiento
- *    aplicados a una versión transformada de la imagen, en forma de tripletas RGB.
- * 5. Muestra en consola los valores cargados desde el archivo de enmascaramiento.
- * 6. Gestiona la memoria dinámicamente, liberando los recursos utilizados.
+ * Sin acción, el programa decodifica el caso del directorio actual:
+ * 1. Carga P3.bmp (imagen transformada), I_M.bmp (ruido) y M.bmp (máscara),
+ *    con verificación opcional de cada una contra su archivo ".sum".
+ * 2. Carga M1.txt y M2.txt (semilla y tripletas enmascaradas) y guarda solo el
+ *    residuo de cada valor respecto de la máscara.
+ * 3. Verifica la cadena de operaciones inversas contra las ventanas de
+ *    enmascaramiento antes de recorrer la imagen completa; si una falla, informa
+ *    un diagnóstico (bits, canales y filas que difieren) y termina.
+ * 4. Simplifica la cadena y la aplica a la imagen completa según el perfil de
+ *    ajuste (núcleo SIMD, bloque, prefetch e hilos), y exporta I_D.bmp.
+ * 5. Registra el caso en la caché: si las entradas y la cadena no cambian y
+ *    I_D.bmp sigue igual, la siguiente ejecución lo informa sin decodificar.
+ *
+ * Acciones (a lo sumo una por ejecución):
+ * - "--lote [--memoria MiB] carpeta1 carpeta2 ...": decodifica varios casos en
+ *   paralelo (un hilo de entrada/salida y trabajadores con robo de trabajo).
+ *   Con "--memoria" los casos se admiten según su memoria estimada y los que no
+ *   caben en el presupuesto se decodifican por bandas de filas.
+ * - "--sondear carpeta1 ...": lee solo cabeceras y semillas de cada caso e
+ *   informa los que son inconsistentes, sin decodificar.
+ * - "--descubrir": deduce la cadena a partir de las ventanas de M1.txt y M2.txt
+ *   y la imprime. "--descubrir-tabla" hace lo mismo consultando una tabla
+ *   precalculada de pares de operaciones.
+ * - "--haz [K]": busca la cadena con un haz de ancho K (8 por defecto),
+ *   tolerando tripletas corruptas en los archivos de enmascaramiento.
+ * - "--muestra inicio fin": evalúa la cadena solo sobre ese rango de bytes y lo
+ *   imprime, sin exportar la imagen.
+ * - "--generar-sumas": escribe P3.bmp.sum, I_M.bmp.sum y M.bmp.sum.
+ * - "--bench-paginas [MiB]" y "--bench-bloques [MiB]": miden los tipos de
+ *   páginas y la calibración de bloque y prefetch sobre datos sintéticos.
+ * - "--autotune [MiB]": mide núcleos, bloques, prefetch e hilos y guarda el
+ *   mejor perfil.
+ * - "--verificar-concurrencia [N] [simultaneas]": decodifica el caso N veces en
+ *   paralelo y compara con la decodificación secuencial.
+ * - "--verificar-simplificacion": prueba la simplificación de cadenas.
  *
  * Entradas:
- * - Archivo de imagen BMP de entrada ("I_O.bmp").
- * - Archivo de salida para guardar la imagen modificada ("I_D.bmp").
- * - Archivo de texto ("M1.txt") que contiene:
- *     • Una línea con la semilla inicial (offset).
- *     • Varias líneas con tripletas RGB resultantes del enmascaramiento.
+ * - P3.bmp, I_M.bmp y M.bmp en el directorio del caso (o en cada carpeta de
+ *   "--lote" y "--sondear"); los BMP de 24 bits sin compresión se leen
+ *   directamente y los demás formatos con QImage.
+ * - M1.txt y M2.txt: una línea con la semilla (offset) y luego tripletas RGB
+ *   resultantes del enmascaramiento.
+ * - Archivos "<imagen>.sum" opcionales con el hash esperado de cada imagen.
+ * - Modificadores del caso (sin acción, con las de descubrimiento, "--haz" y
+ *   "--muestra"):
+ *     • "--ruidos imagen1 ...": imágenes de ruido adicionales (ids 1, 2, ...).
+ *     • "--cadena archivo": decodifica con la cadena del archivo; al descubrir,
+ *       guarda ahí la cadena encontrada.
+ *     • "--prng semilla": el ruido se genera con un PRNG en lugar de I_M.bmp.
+ *     • "--validar-mascaras": recorre M1.txt y M2.txt completos y los rechaza si
+ *       el resto está mal formado.
+ *     • "--sin-cache": no consulta ni actualiza la caché.
  *
  * Salidas:
- * - Imagen BMP modificada ("I_D.bmp").
- * - Datos RGB leídos desde el archivo de enmascaramiento impresos por consola.
+ * - Imagen BMP recuperada ("I_D.bmp"), en el directorio del caso o en cada
+ *   carpeta del lote.
+ * - "cache_desafio.txt": claves de los casos ya decodificados y su cadena.
+ * - "perfil_desafio.txt": perfil de ajuste escrito por "--autotune".
+ * - Archivos ".sum" escritos por "--generar-sumas".
+ * - Mensajes por consola: verificación, diagnóstico, cadenas encontradas,
+ *   muestras y mediciones.
  *
  * Requiere:
- * - Librerías Qt para manejo de imágenes (QImage, QString).
- * - No utiliza estructuras ni STL. Solo arreglos dinámicos y memoria básica de C++.
+ * - Librerías Qt para manejo de imágenes e hilos (QImage, QString, QThread,
+ *   QMutex, QWaitCondition).
+ * - No utiliza estructuras ni contenedores de la STL: los datos van en arreglos
+ *   dinámicos y arreglos paralelos de enteros. De la biblioteca estándar solo se
+ *   usan string y flujos para rutas y archivos, y atomic para las colas del
+ *   procesamiento por lotes.
  */
 #include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QImage>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <new>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DESAFIO_X86 1
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
     using namespace std;
 // Carga los píxeles de una imagen BMP
 unsigned char* loadPixels(QString path, int &width, int &height);
+// Igual que loadPixels pero además entrega en "suma" el hash de los píxeles
+// RGB cargados. Si existe el archivo "<path>.sum" con una suma distinta, la
+// imagen se considera corrupta y retorna nullptr.
+unsigned char* loadPixels(QString path, int &width, int &height, unsigned long long &suma);
+// Bytes por tira de filas al cargar un BMP de 24 bits (memoria temporal de la carga)
+const int TIRA_BMP = 1 << 20;
+// Lee solo la cabecera de un BMP (54 bytes) sin decodificar los píxeles. "alto"
+// es negativo si las filas están de arriba hacia abajo. Retorna false si el
+// archivo no existe, no es un BMP o la cabecera no cuadra con su tamaño.
+bool leerCabeceraBmp(const char* ruta, int &ancho, int &alto, int &bits, int &compresion,
+                     int &inicioDatos, long long &tamArchivo);
 // Guarda los píxeles en una imagen BMP
 bool exportImage(unsigned char* data, int width, int height, QString path);
-// Carga la semilla y datos de enmascaramiento desde un archivo de texto
-unsigned int* loadSeedMasking(const char* file, int &seed, int &n_pixels);
+// Carga la semilla y datos de enmascaramiento desde un archivo de texto. Parsea
+// solo la semilla y los primeros "valoresNecesarios" valores y deja de leer.
+// En lugar de S guarda un byte por valor con el residuo (S[k] - mask[k]) & 0xFF,
+// que es lo único que usa el desenmascarado. Con "validarResto" recorre también
+// el resto del archivo y lo rechaza si tiene valores fuera de rango o tripletas
+// incompletas.
+unsigned char* loadSeedMasking(const char* file, int &seed, int &n_pixels,
+                               const unsigned char* mask, int valoresNecesarios,
+                               bool validarResto);
+
+// Tipo de páginas para los buffers de píxeles. Con imágenes grandes los pasos
+// recorren a la vez img, ruido y máscara; con páginas de 2 MiB se necesitan
+// 512 veces menos entradas de TLB que con páginas de 4 KiB.
+const int PAGINAS_NORMALES = 0; // malloc
+const int PAGINAS_THP = 1;      // Alineado a 2 MiB con madvise(MADV_HUGEPAGE)
+const int PAGINAS_HUGETLB = 2;  // mmap con MAP_HUGETLB (si falla, THP)
+const int PAGINAS_AUTO = 3;     // HUGETLB desde UMBRAL_PAGINAS_GRANDES, si no normales
+const long long UMBRAL_PAGINAS_GRANDES = 8LL << 20;
+// Reserva un buffer de píxeles (se libera con liberarPixeles, no con delete).
+// Lanza bad_alloc si no hay memoria, igual que new.
+unsigned char* reservarPixeles(long long bytes, int modo = PAGINAS_AUTO);
+void liberarPixeles(unsigned char* datos);
+// Compara el tiempo y los fallos de TLB de datos de la cadena inversa completa
+// sobre datos sintéticos de "megas" MiB con cada tipo de páginas.
+void medirPaginas(int megas);
+
+// Tipos de operación de la cadena inversa. Cada paso ocupa CAMPOS_PASO enteros
+// consecutivos en el arreglo de la cadena: {tipo, parámetro, reservado}. En el
+// XOR con ruido el campo reservado es el id de la imagen en la biblioteca.
+const int OP_XOR_RUIDO = 0;     // XOR con el ruido de id "reservado" desplazado "parámetro" bytes
+const int OP_ROT_IZQ = 1;       // Rotación a la izquierda de "parámetro" bits
+const int OP_ROT_DER = 2;       // Rotación a la derecha de "parámetro" bits
+const int OP_DESP_IZQ = 3;      // Desplazamiento a la izquierda de "parámetro" bits
+const int OP_DESP_DER = 4;      // Desplazamiento a la derecha de "parámetro" bits
+const int OP_DESENMASCARAR = 5; // Desenmascarar con el archivo de índice "parámetro"
+// Operaciones que cambian la posición de los píxeles (no son locales al byte).
+// Se ejecutan como un "gather" con una tabla de origen por píxel de salida.
+const int OP_ROT_FILAS = 6;      // Rota las filas "parámetro" posiciones hacia abajo
+const int OP_ROT_COLUMNAS = 7;   // Rota las columnas "parámetro" posiciones a la derecha
+const int OP_PERMUTAR = 8;       // Permutación de píxeles generada con la semilla "parámetro"
+const int OP_PERMUTAR_INV = 9;   // Inversa de la permutación con la semilla "parámetro"
+const int OP_XOR_CONST = 10;     // XOR con la constante "parámetro" (0xFF = NOT)
+const int OP_XOR_PRNG = 11;      // XOR con el flujo pseudoaleatorio de semilla "parámetro"
+                                 // y algoritmo "reservado" (PRNG_SPLITMIX64)
+const int PRNG_SPLITMIX64 = 0;
+const int CAMPOS_PASO = 3;
+
+// Palabra número "contador" del flujo pseudoaleatorio: splitmix64 usado como
+// generador basado en contador, así cualquier byte del flujo se obtiene sin
+// generar los anteriores (el byte i es el byte i % 8 de la palabra i / 8).
+static inline unsigned long long palabraPrng(unsigned long long semilla,
+                                             unsigned long long contador) {
+    unsigned long long z = semilla + (contador + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Indica si un tipo de paso mueve píxeles de posición
+static inline bool esPermutacion(int tipo) {
+    return tipo >= OP_ROT_FILAS && tipo <= OP_PERMUTAR_INV;
+}
+
+// Indica si un tipo de paso es un XOR con un flujo fijo (ruido, constante o PRNG)
+static inline bool esXor(int tipo) {
+    return tipo == OP_XOR_RUIDO || tipo == OP_XOR_CONST || tipo == OP_XOR_PRNG;
+}
+
+// Aplica un paso de la cadena (que no sea desenmascarar) sobre datos[0..len),
+// donde datos[j] corresponde al byte base + j de la imagen completa. El XOR
+// usa la imagen de ruido ruidos[id] del paso; tamRuido es su tamaño en bytes,
+// necesario para el XOR con desplazamiento.
+void aplicarPaso(unsigned char* datos, int base, int len,
+                 const unsigned char* const* ruidos, int tamRuido, const int* paso);
+// Evaluación dispersa: evalúa los primeros nPasos de la cadena solo sobre los
+// rangos de bytes [rangos[2r], rangos[2r+1]) y escribe los resultados contiguos
+// en "salida". Retorna la cantidad de bytes escritos.
+int evaluarRangos(const unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                  const int* cadena, int nPasos, int totalMaskBytes,
+                  unsigned char** S, const int* semillas,
+                  int* const* perms, const int* rangos, int nRangos,
+                  unsigned char* salida);
+// Verifica la cadena solo sobre las ventanas de enmascaramiento, sin recorrer
+// la imagen completa. Retorna -1 si todo es consistente o el índice del paso
+// de desenmascarado que falla.
+int verificarVentanas(const unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                      const int* cadena, int nPasos, int totalMaskBytes, unsigned char** S,
+                      const int* semillas, const int* nPix, int* const* perms);
+// Diagnóstico de una ventana que no coincide: arreglo de DIAG_TOTAL enteros
+const int DIAG_BYTES = 0;     // Bytes comparados
+const int DIAG_DISTINTOS = 1; // Bytes que difieren
+const int DIAG_CANAL = 2;     // 3 entradas (R, G, B): bytes que difieren por canal
+const int DIAG_BIT = 5;       // 8 entradas: veces que difiere cada bit (0 = menos significativo)
+const int DIAG_ROTADA = 13;   // 7 entradas: bytes que coinciden si la ventana se rota
+                              // k = 1..7 bits a la izquierda
+const int DIAG_TOTAL = 20;
+// Compara "len" bytes de la ventana reconstruida con los residuos y acumula en
+// "diag" (y en "porFila", bytes distintos por fila de la máscara, si no es
+// nullptr). "inicio" es la posición del primer byte dentro de la ventana, para
+// ubicar canal y fila cuando se compara solo un tramo. La ventana empieza en
+// img[seed], así que el canal del byte i de la ventana es (seed + i) % 3.
+void compararVentana(const unsigned char* ventana, const unsigned char* residuos, int len,
+                     int seed, int inicio, int bytesFila, int* diag, int* porFila);
+// Reconstruye la ventana del paso "fallo" (índice retornado por
+// verificarVentanas) y la compara completa. Retorna false si el paso falló por
+// datos faltantes (semilla fuera de la imagen, archivo corto) y no hay nada que
+// comparar. "porFila" debe tener totalMaskBytes / bytesFila entradas.
+bool diagnosticarVentana(const unsigned char* img, int dataSize,
+                         const unsigned char* const* ruidos, const int* cadena, int fallo,
+                         int totalMaskBytes, int bytesFila, unsigned char** S,
+                         const int* semillas, const int* nPix, int* const* perms,
+                         int* diag, int* porFila);
+// Imprime el diagnóstico y, si los números lo indican, el tipo de error probable
+void informarDiagnostico(const int* diag, const int* porFila, int nFilas);
+// Simplifica algebraicamente una cadena sin pasos de desenmascarado (rotaciones
+// acumuladas, XOR dobles y pasos nulos). Retorna la nueva cantidad de pasos.
+int simplificarCadena(int* cadena, int nPasos);
+// Prueba simplificarCadena sobre cadenas fijas (entre ellas XOR que se cancelan
+// sin estar juntos): la cantidad de pasos esperada y el mismo resultado que la
+// cadena original sobre datos sintéticos. Retorna cuántas fallan.
+int verificarSimplificacion();
+// Perfil de ajuste del ejecutor: arreglo de AJ_TOTAL enteros
+const int AJ_BLOQUE = 0;   // Bytes por bloque en la parte de imagen completa (0 = sin bloques)
+const int AJ_PREFETCH = 1; // Distancia de prefetch en bytes (0 = sin prefetch)
+const int AJ_HILOS = 2;    // Hilos que se reparten los bloques
+const int AJ_VARIANTE = 3; // Núcleo de los XOR y rotaciones (VAR_*)
+const int AJ_ROTACION = 4; // Rotación del núcleo escalar (ROT_*)
+const int AJ_TOTAL = 5;
+const int VAR_ESCALAR = 0; // aplicarPaso tal cual
+const int VAR_SSE2 = 1;
+const int VAR_AVX2 = 2;
+const int VAR_AVX512 = 3;  // Requiere AVX-512BW
+const int ROT_DESPLAZAMIENTO = 0; // (v << k) | (v >> (8 - k))
+const int ROT_TABLA = 1;          // Tabla de 256 entradas
+const int UMBRAL_CALIBRACION = 16 << 20; // Imágenes desde este tamaño calibran al inicio
+// Llena el perfil con los valores por defecto
+void perfilPorDefecto(int* perfil);
+// Indica si el procesador permite usar la variante de núcleo
+bool varianteDisponible(int variante);
+// Prueba combinaciones de bloque y prefetch sobre "megas" MiB sintéticos y deja
+// en el perfil la más rápida. Con "mostrar" imprime todos los tiempos.
+void calibrarPerfil(int* perfil, int megas, bool mostrar);
+// Ajuste completo: variante de núcleo, bloque y prefetch, y cantidad de hilos,
+// uno tras otro sobre "megas" MiB sintéticos. Imprime cada medición.
+void autoajustar(int* perfil, int megas);
+// Lee/escribe el perfil como líneas "nombre valor". Al leer se ignoran los
+// nombres desconocidos y una variante que el procesador no tenga.
+bool cargarPerfil(const char* ruta, int* perfil);
+bool guardarPerfil(const char* ruta, const int* perfil);
+// Ejecuta la cadena separándola en una parte de imagen completa (ya simplificada)
+// y una parte restringida a las ventanas de desenmascarado. La parte completa
+// se recorre por bloques según el perfil (nullptr = valores por defecto).
+// Retorna la cantidad de pasadas completas realizadas.
+int ejecutarCadenaOptimizada(unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                             const int* cadena, int nPasos, int totalMaskBytes,
+                             unsigned char** S, const int* semillas,
+                             int* const* perms, const int* perfil = nullptr);
+// Ejecuta la cadena completa sobre la imagen
+void ejecutarCadena(unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                    const int* cadena, int nPasos, int totalMaskBytes,
+                    unsigned char** S, const int* semillas,
+                    int* const* perms);
+
+// Construye las tablas de origen de los pasos de permutación (nullptr para los
+// demás pasos). Se liberan con liberarPermutaciones.
+int** prepararPermutaciones(const int* cadena, int nPasos, int ancho, int alto);
+void liberarPermutaciones(int** perms, int nPasos);
+// Genera la permutación de n píxeles asociada a una semilla y su inversa
+void generarPermutacion(int* tabla, int n, unsigned int semilla);
+void invertirPermutacion(const int* tabla, int* inversa, int n);
+// Reordena los píxeles: destino[p] = origen[tabla[p]] (con prefetch)
+void permutarPixeles(const unsigned char* origen, unsigned char* destino,
+                     const int* tabla, int nPixeles);
+
+// Biblioteca de ruido: arreglos paralelos indexados por id (ruidos[id],
+// hashes[id]) más un índice por hash de direccionamiento abierto. Todas las
+// imágenes tienen las dimensiones del caso. Una vez cargada es de solo lectura
+// y puede compartirse entre hilos sin sincronización.
+const int MAX_RUIDOS = 16;
+const int TAM_INDICE_RUIDO = 2 * MAX_RUIDOS; // Potencia de 2
+// Hash de 64 bits por bloques con 4 carriles independientes. El estado son 4
+// enteros de 64 bits; hashBloques solo acepta múltiplos de 32 bytes para poder
+// encadenar lecturas de un archivo por partes.
+void hashIniciar(unsigned long long* estado);
+void hashBloques(unsigned long long* estado, const unsigned char* datos, long long len);
+unsigned long long hashFinal(const unsigned long long* estado, const unsigned char* cola,
+                             int lenCola, long long total);
+// Hash de 64 bits de un bloque de bytes
+unsigned long long hashBytes(const unsigned char* datos, long long len);
+// Hash del contenido de un archivo leído por partes. Retorna false si no existe.
+bool hashArchivo(const char* ruta, unsigned long long &h);
+
+// Caché de resultados en disco: cada línea del archivo es
+//   <clave> <hash de I_D> <ruta de I_D> <nPasos> <pasos de la cadena...>
+// donde la clave combina los hashes de todos los archivos de entrada del caso
+// (incluidos los ruidos de --ruidos) con la cadena aplicada, la semilla del
+// PRNG y VERSION_CADENA.
+const int VERSION_CADENA = 2; // incrementar al cambiar las operaciones o el PRNG
+unsigned long long claveCaso(const char* const* archivos, int nArchivos, long long extra);
+bool buscarEnCache(const char* rutaCache, unsigned long long clave, char* rutaSalida,
+                   int maxRuta, int* cadena, int &nPasos, int maxPasos);
+void guardarEnCache(const char* rutaCache, unsigned long long clave, unsigned long long hashSalida,
+                    const char* rutaSalida, const int* cadena, int nPasos);
+// Agrega una imagen ya cargada a la biblioteca. Retorna su id; si ya había una
+// con el mismo contenido retorna ese id y no la agrega (el llamador la libera).
+int agregarRuido(unsigned char* pixeles, int dataSize, unsigned char** ruidos,
+                 unsigned long long* hashes, int* indice, int &nRuidos);
+// Busca un ruido por hash en O(1). Retorna su id o -1.
+int buscarRuidoPorHash(const int* indice, const unsigned long long* hashes,
+                       unsigned long long h);
+void liberarRuidos(unsigned char** ruidos, int nRuidos);
+
+// Descubrimiento por análisis de bits: a partir de la ventana antes del paso
+// (x), el ruido en las mismas posiciones (n) y la ventana esperada (y), deduce
+// en una sola pasada todas las operaciones de hasta dos pasos que explican los
+// datos. Cada candidato ocupa 2 * CAMPOS_PASO enteros y su cantidad de pasos se
+// guarda en "longitudes". Retorna cuántos candidatos hay (más de uno = ambiguo).
+int descubrirPorBits(const unsigned char* x, const unsigned char* n,
+                     const unsigned char* y, int len, int* candidatos,
+                     int* longitudes, int maxCand);
+// Funciones de un byte indexadas por la tabla de pares: identidad (tipo -1),
+// rotaciones, desplazamientos y NOT. Retorna la cantidad (máximo 64).
+int generarFuncionesTabla(int* funciones, int maxFunciones);
+// Construye la tabla de 256 x 256 entradas: tabla[(x << 8) | y] tiene el bit f
+// encendido si la función f lleva el byte x al byte y. Se construye una sola
+// vez y se comparte entre casos; se libera con delete [].
+unsigned long long* construirTablaPares();
+// Igual que descubrirPorBits pero consultando la tabla de pares: los
+// candidatos son f(x) y f(x ^ n) para cada función f de la tabla.
+int descubrirPorTabla(const unsigned long long* tabla, const unsigned char* x,
+                      const unsigned char* n, const unsigned char* y, int len,
+                      int* candidatos, int* longitudes, int maxCand);
+// Busca el bloque d[0..len) dentro de imRand tomado como circular. Escribe
+// hasta maxPos posiciones de inicio y retorna cuántas hay.
+int buscarEnRuido(const unsigned char* d, int len, const unsigned char* imRand,
+                  int tamRuido, int* posiciones, int maxPos);
+// Detecta un XOR con el ruido desplazado (solo o combinado con una rotación)
+// que lleva la ventana x que empieza en "seed" a y. Mismo formato de
+// candidatos que descubrirPorBits.
+int descubrirDesplazamientoRuido(const unsigned char* x, const unsigned char* y, int len,
+                                 int seed, const unsigned char* imRand, int tamRuido,
+                                 int* candidatos, int* longitudes, int maxCand);
+// Descubre la cadena inversa etapa por etapa usando los archivos de
+// enmascaramiento del último al primero. Si "tabla" no es nulo se usa la
+// tabla de pares en lugar del análisis por bits. Con semillaPrng >= 0 el XOR
+// con el flujo del PRNG se prueba junto a los ruidos de la biblioteca.
+// Retorna la cantidad de pasos encontrados (incluye los desenmascarados) o -1
+// si alguna etapa es ambigua o no tiene explicación.
+int descubrirCadena(const unsigned char* img, int dataSize,
+                    const unsigned char* const* ruidos, int nRuidos, int semillaPrng,
+                    int totalMaskBytes, unsigned char** S,
+                    const int* semillas, const int* nPix, int nMascaras,
+                    const unsigned long long* tabla, int* cadena, int maxPasos);
+// Imprime un paso de la cadena en forma legible
+void imprimirPaso(const int* paso);
+// Transpone len bytes a 8 planos de bits: el bit j de la palabra w del plano b
+// es el bit b del byte 64 * w + j. Retorna la cantidad de palabras por plano.
+int transponerPlanos(const unsigned char* v, int len, unsigned long long* planos);
+// Evaluación "bitsliced": prueba todas las operaciones locales al byte del
+// vocabulario a la vez sobre los planos de la ventana x y escribe
+// para cada candidato un mapa de bits de coincidencias con y (nPalabras
+// palabras por candidato). n contiene la ventana de cada uno de los nRuidos
+// ruidos, una tras otra, y "flujo" la del PRNG (nullptr si no se usa).
+// Retorna la cantidad de palabras por candidato.
+int evaluarPlanos(const unsigned char* x, const unsigned char* n, int nRuidos,
+                  const unsigned char* flujo, const unsigned char* y, int len,
+                  const int* vocabulario, int nVoc, unsigned long long* coincidencias);
+// Llena "pasos" con el vocabulario de operaciones de un paso que se prueban en
+// la búsqueda por haz (un XOR por cada ruido de la biblioteca y, con
+// semillaPrng >= 0, el XOR con el flujo del PRNG). Retorna la cantidad de
+// operaciones.
+int generarVocabulario(int* pasos, int maxPasos, int nRuidos, int semillaPrng);
+// Búsqueda por haz (beam search) tolerante a tripletas corruptas: en cada etapa
+// conserva las anchoHaz cadenas parciales con mejor proporción de coincidencias
+// contra (S[k] - mask[k]). Retorna la cantidad de pasos de la mejor cadena y su
+// proporción media de coincidencias en "puntaje".
+int buscarCadenaHaz(const unsigned char* img, int dataSize,
+                    const unsigned char* const* ruidos, int nRuidos, int semillaPrng,
+                    int totalMaskBytes, unsigned char** S,
+                    const int* semillas, const int* nPix, int nMascaras, int anchoHaz,
+                    int* cadena, int maxPasos, double &puntaje);
+// Coincidencia media mínima para aceptar la cadena del haz cuando no pasa la
+// verificación exacta (tolerancia a tripletas corruptas)
+const double UMBRAL_HAZ = 0.9;
+
+// Cadena inversa fija de este caso (5 pasos). Con semillaPrng >= 0 los XOR
+// usan el flujo pseudoaleatorio en lugar de I_M.bmp. Retorna nPasos.
+int cadenaDelCaso(int* cadena, int semillaPrng);
+// Archivo de cadena: un paso por línea ("tipo parámetro reservado", con los
+// valores de OP_*); las líneas que empiezan con '#' son comentarios. Permite
+// decodificar con una cadena descubierta en lugar de la fija. cargarCadena
+// retorna la cantidad de pasos o -1 si el archivo no existe o tiene un paso
+// inválido.
+int cargarCadena(const char* ruta, int* cadena, int maxPasos, int nMascaras);
+bool guardarCadena(const char* ruta, const int* cadena, int nPasos, const char* comentario);
+// API reentrante de decodificación. No hay estado global: cada llamada
+// reserva y libera sus propios buffers, las entradas solo se leen y los hilos
+// que pida el perfil se crean y terminan dentro de la llamada. Por eso se
+// puede llamar desde varios hilos a la vez, incluso sobre el mismo caso. Lo
+// único compartido es la salida de mensajes de error (cout/cerr).
+//
+// Aplica la cadena a una imagen ya cargada: prepara las permutaciones,
+// verifica por ventanas y ejecuta. Retorna -1 si se aplicó o el índice del
+// paso de desenmascarado que falla (la imagen queda sin cambios).
+int decodificarEnMemoria(unsigned char* img, int ancho, int alto,
+                         const unsigned char* const* ruidos, const int* cadena, int nPasos,
+                         int totalMaskBytes, unsigned char** S, const int* semillas,
+                         const int* nPix, const int* perfil);
+// Carga el caso de "carpeta" (P3.bmp, I_M.bmp, M.bmp, M1.txt, M2.txt), le
+// aplica la cadena y retorna la imagen decodificada (se libera con
+// liberarPixeles), o nullptr si falta un archivo o la verificación falla.
+unsigned char* decodificarCaso(const char* carpeta, const int* cadena, int nPasos,
+                               const int* perfil, int &ancho, int &alto);
+// Lanza "total" decodificaciones del caso de "carpeta" en hilos, de a
+// "simultaneas" a la vez y con perfiles variados (núcleo e hilos), y compara
+// cada resultado byte a byte con el de ejecutarCadena. Retorna cuántas
+// difieren o fallan (-1 si no se pudo obtener la referencia).
+int verificarConcurrencia(const char* carpeta, int total, int simultaneas);
+// Decodifica los casos de varias carpetas (cada una con sus P3.bmp, I_M.bmp,
+// M.bmp, M1.txt y M2.txt) y exporta I_D.bmp en cada una. El hilo que llama
+// hace toda la lectura y escritura de archivos mientras los nHilos
+// trabajadores calculan; los trabajadores tienen una cola propia y, cuando se
+// vacía, roban tareas de las demás. Retorna cuántos casos fallaron.
+// Con presupuesto > 0 solo se cargan casos mientras la memoria estimada de los
+// que están en vuelo quepa en él (en bytes); 0 = la mitad de la memoria física.
+int procesarLote(const char* const* carpetas, int nCasos, int nHilos,
+                 long long presupuesto = 0);
+// Memoria estimada para decodificar el caso de "carpeta" a partir de las
+// cabeceras BMP y del tamaño de los archivos de texto, sin leer los píxeles.
+// En bytesImagen deja el tamaño de la imagen. Retorna -1 si no hay P3.bmp.
+long long estimarMemoriaCaso(const char* carpeta, long long &bytesImagen);
+// Modo por bandas para casos que no caben en memoria: lee P3.bmp e I_M.bmp por
+// grupos de filas, verifica primero las ventanas leyendo solo sus filas, aplica
+// la cadena y escribe I_D.bmp directamente. Solo admite cadenas locales al byte con XOR
+// sin desplazamiento y BMP de 24 bits.
+bool decodificarPorBandas(const char* carpeta, const int* cadena, int nPasos, int bytesBanda);
+
+// Sonda de metadatos de un caso: arreglo de SONDA_TOTAL enteros llenado sin
+// decodificar imágenes (solo cabeceras BMP) y contando líneas en los M*.txt.
+// Los campos de un archivo que falta quedan en -1.
+const int SONDA_ANCHO = 0;        // P3.bmp
+const int SONDA_ALTO = 1;
+const int SONDA_BITS = 2;
+const int SONDA_ANCHO_RUIDO = 3;  // I_M.bmp
+const int SONDA_ALTO_RUIDO = 4;
+const int SONDA_BITS_RUIDO = 5;
+const int SONDA_ANCHO_M = 6;      // M.bmp
+const int SONDA_ALTO_M = 7;
+const int SONDA_BITS_M = 8;
+const int SONDA_SEMILLA_1 = 9;    // M1.txt: semilla y tripletas (líneas - 1)
+const int SONDA_TRIPLETAS_1 = 10;
+const int SONDA_SEMILLA_2 = 11;   // M2.txt
+const int SONDA_TRIPLETAS_2 = 12;
+const int SONDA_TOTAL = 13;
+void sondearCaso(const char* carpeta, int* sonda);
+// Cuenta los saltos de línea de un archivo (con SSE2/AVX2 en x86). Si el
+// archivo no termina en salto de línea la última línea también cuenta. En
+// "primero" deja el entero de la primera línea. Retorna -1 si no existe.
+long long contarLineas(const char* ruta, long long &primero);
 
 // Función para revertir el enmascaramiento (lineal):
 // Se asume que "seed" es el offset en el buffer donde empieza la región afectada.
-void desenmascarar(unsigned char* img, const unsigned char* mask,
-                   const unsigned int* S, int seed, int totalBytes) {
-    if (!img || !mask || !S || totalBytes <= 0)
+// "S" ya trae los residuos (S[k] - mask[k]) & 0xFF calculados al cargarlo, así
+// que la ventana se copia tal cual.
+void desenmascarar(unsigned char* img, const unsigned char* S, int seed, int totalBytes) {
+    if (!img || !S || totalBytes <= 0)
         return;
-    for (int k = 0; k < totalBytes; ++k) {
-        // Se convierte el resultado (S[k] - mask[k]) a unsigned char (rango 0-255)
-        img[seed + k] = static_cast<unsigned char>((S[k] - mask[k]) & 0xFF);
-    }
+    memcpy(img + seed, S, totalBytes);
 }
 
 // Operaciones a nivel de bits
@@ -61,108 +493,581 @@ static inline unsigned char brotate_left(unsigned char v, unsigned k) {
     return static_cast<unsigned char>(((v << k) | (v >> (8 - k))) & 0xFF);
 }
 
+// Guarda en "ruta" (si no es nullptr) una cadena encontrada por --descubrir o
+// --haz para decodificar después con --cadena. El paso posterior al último
+// desenmascarado no deja rastro en los archivos: se agrega como supuesto el
+// primero de la cadena si es un XOR (las dos puntas del caso usan el mismo
+// ruido) y se deja anotado en el archivo para poder corregirlo. Retorna nPasos
+// o -1 si no se pudo escribir.
+static int guardarDescubierta(const char* ruta, int* cadena, int nPasos, int maxPasos) {
+    if (!ruta)
+        return nPasos;
+    int tipo = cadena[0];
+    const char* nota = nullptr;
+    if ((tipo == OP_XOR_RUIDO || tipo == OP_XOR_PRNG || tipo == OP_XOR_CONST) &&
+        nPasos < maxPasos) {
+        for (int c = 0; c < CAMPOS_PASO; ++c)
+            cadena[nPasos * CAMPOS_PASO + c] = cadena[c];
+        ++nPasos;
+        nota = "el ultimo paso es supuesto igual al primero, no se deduce de los archivos";
+    } else {
+        nota = "falta el paso posterior a M1.txt, no se deduce de los archivos";
+    }
+    if (!guardarCadena(ruta, cadena, nPasos, nota)) {
+        cerr << "Error al escribir " << ruta << endl;
+        return -1;
+    }
+    cout << "Cadena guardada en " << ruta << ". Nota: " << nota << "." << endl;
+    return nPasos;
+}
+
+// Convierte un argumento entero de la línea de comandos. Retorna false si el
+// texto no es un número completo.
+static bool argumentoEntero(const char* texto, long long &valor) {
+    char* fin = nullptr;
+    valor = strtoll(texto, &fin, 10);
+    return fin != texto && *fin == '\0';
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
     Q_UNUSED(app);
 
+    // Línea de comandos: todas las opciones se recorren en un solo ciclo. Hay a
+    // lo sumo una acción (sin acción se decodifica el caso del directorio
+    // actual), con sus argumentos numéricos a continuación; los modificadores
+    // del caso pueden ir en cualquier posición. "--lote" y "--sondear" toman
+    // como carpetas todo lo que les sigue. Una opción desconocida o fuera de
+    // lugar termina con error en lugar de ignorarse.
+    const char* ACCIONES[] = { "--bench-paginas", "--bench-bloques", "--autotune",
+                               "--verificar-concurrencia", "--lote", "--sondear",
+                               "--generar-sumas", "--descubrir", "--descubrir-tabla",
+                               "--haz", "--muestra", "--verificar-simplificacion" };
+    const int MIN_NUMEROS[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0 };
+    const int MAX_NUMEROS[] = { 1, 1, 1, 2, 0, 0, 0, 0, 0, 1, 2, 0 };
+    const int N_ACCIONES = 12;
+    const char* accion = nullptr;
+    long long numeros[2] = { 0, 0 }; // Argumentos numéricos de la acción
+    int nNumeros = 0;
+    int primeraCarpeta = argc;       // "--lote" y "--sondear"
+    long long presupuesto = 0;       // "--memoria MiB" (solo con --lote)
+    // "--prng semilla": el ruido se genera con el PRNG en lugar de leerse de
+    // I_M.bmp, que entonces no se carga.
+    int semillaPrng = -1;
+    // "--validar-mascaras": M1.txt y M2.txt se recorren completos y se rechazan
+    // si lo que sigue a los valores usados está mal formado.
+    bool validarMascaras = false;
+    bool sinCache = false;
+    int inicioRuidos = argc, finRuidos = argc; // "--ruidos imagen1 imagen2 ..."
+    // "--cadena archivo": con --descubrir o --haz guarda ahí la cadena
+    // encontrada; en los demás casos decodifica con la cadena del archivo en
+    // lugar de la fija
+    const char* rutaCadena = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        const char* opcion = argv[i];
+        int indice = -1;
+        for (int k = 0; k < N_ACCIONES; ++k)
+            if (strcmp(opcion, ACCIONES[k]) == 0)
+                indice = k;
+        long long valor = 0;
+        if (indice >= 0) {
+            if (accion) {
+                cerr << "Error: solo se admite una accion (" << accion << " y " << opcion
+                     << ")." << endl;
+                return 1;
+            }
+            accion = ACCIONES[indice];
+            if (strcmp(accion, "--lote") == 0 || strcmp(accion, "--sondear") == 0) {
+                int j = i + 1;
+                if (strcmp(accion, "--lote") == 0 && j < argc &&
+                    strcmp(argv[j], "--memoria") == 0) {
+                    if (j + 1 >= argc || !argumentoEntero(argv[j + 1], valor) || valor <= 0) {
+                        cerr << "Error: --memoria requiere una cantidad de MiB." << endl;
+                        return 1;
+                    }
+                    presupuesto = valor << 20;
+                    j += 2;
+                }
+                primeraCarpeta = j;
+                for (; j < argc; ++j)
+                    if (strncmp(argv[j], "--", 2) == 0) {
+                        cerr << "Error: opcion fuera de lugar despues de " << accion << ": "
+                             << argv[j] << endl;
+                        return 1;
+                    }
+                if (primeraCarpeta >= argc) {
+                    cerr << "Error: " << accion << " requiere al menos una carpeta." << endl;
+                    return 1;
+                }
+                break;
+            }
+            while (nNumeros < MAX_NUMEROS[indice] && i + 1 < argc &&
+                   argumentoEntero(argv[i + 1], valor)) {
+                numeros[nNumeros++] = valor;
+                ++i;
+            }
+            if (nNumeros < MIN_NUMEROS[indice]) {
+                cerr << "Error: " << accion << " requiere " << MIN_NUMEROS[indice]
+                     << " argumentos numericos." << endl;
+                return 1;
+            }
+        } else if (strcmp(opcion, "--prng") == 0) {
+            if (i + 1 >= argc || !argumentoEntero(argv[i + 1], valor) || valor < 0 ||
+                valor > 0x7FFFFFFF) {
+                cerr << "Error: --prng requiere una semilla no negativa." << endl;
+                return 1;
+            }
+            semillaPrng = static_cast<int>(valor);
+            ++i;
+        } else if (strcmp(opcion, "--validar-mascaras") == 0) {
+            validarMascaras = true;
+        } else if (strcmp(opcion, "--sin-cache") == 0) {
+            sinCache = true;
+        } else if (strcmp(opcion, "--cadena") == 0) {
+            if (i + 1 >= argc || strncmp(argv[i + 1], "--", 2) == 0) {
+                cerr << "Error: --cadena requiere un archivo." << endl;
+                return 1;
+            }
+            rutaCadena = argv[++i];
+        } else if (strcmp(opcion, "--ruidos") == 0) {
+            inicioRuidos = i + 1;
+            finRuidos = inicioRuidos;
+            while (finRuidos < argc && strncmp(argv[finRuidos], "--", 2) != 0)
+                ++finRuidos;
+            if (finRuidos == inicioRuidos) {
+                cerr << "Error: --ruidos requiere al menos una imagen." << endl;
+                return 1;
+            }
+            i = finRuidos - 1;
+        } else {
+            cerr << "Error: opcion desconocida o fuera de lugar: " << opcion << endl;
+            return 1;
+        }
+    }
+    // Los modificadores del caso solo tienen sentido al trabajar sobre el caso
+    // del directorio actual
+    bool accionDelCaso = !accion || strncmp(accion, "--descubrir", 11) == 0 ||
+                         strcmp(accion, "--haz") == 0 || strcmp(accion, "--muestra") == 0;
+    if (!accionDelCaso && (semillaPrng >= 0 || validarMascaras || sinCache ||
+                           inicioRuidos < argc || rutaCadena)) {
+        cerr << "Error: --prng, --ruidos, --cadena, --validar-mascaras y --sin-cache no se"
+                " usan con " << accion << "." << endl;
+        return 1;
+    }
+    // Cadena a aplicar: la del archivo de --cadena (salvo al descubrir, donde
+    // es la salida) o la fija del caso
+    bool descubriendo = accion && (strncmp(accion, "--descubrir", 11) == 0 ||
+                                   strcmp(accion, "--haz") == 0);
+    int cadena[16 * CAMPOS_PASO];
+    int nPasos = 0;
+    if (rutaCadena && !descubriendo) {
+        nPasos = cargarCadena(rutaCadena, cadena, 16, 2);
+        if (nPasos <= 0) {
+            cerr << "Error: " << rutaCadena << " no tiene una cadena valida." << endl;
+            return 1;
+        }
+    } else {
+        nPasos = cadenaDelCaso(cadena, semillaPrng);
+    }
+
+    // "--bench-paginas [MiB]": compara los tipos de páginas y termina
+    if (accion && strcmp(accion, "--bench-paginas") == 0) {
+        medirPaginas(nNumeros > 0 ? static_cast<int>(numeros[0]) : 64);
+        return 0;
+    }
+
+    // "--bench-bloques [MiB]": muestra la calibración de bloque y prefetch
+    if (accion && strcmp(accion, "--bench-bloques") == 0) {
+        int perfil[AJ_TOTAL];
+        perfilPorDefecto(perfil);
+        calibrarPerfil(perfil, nNumeros > 0 ? static_cast<int>(numeros[0]) : 32, true);
+        return 0;
+    }
+
+    // "--autotune [MiB]": mide las combinaciones de núcleo, bloque, prefetch e
+    // hilos y guarda la mejor en el perfil que se carga al decodificar
+    const char* RUTA_PERFIL = "perfil_desafio.txt";
+    if (accion && strcmp(accion, "--autotune") == 0) {
+        int perfil[AJ_TOTAL];
+        perfilPorDefecto(perfil);
+        autoajustar(perfil, nNumeros > 0 ? static_cast<int>(numeros[0]) : 16);
+        if (!guardarPerfil(RUTA_PERFIL, perfil)) {
+            cerr << "Error al escribir " << RUTA_PERFIL << endl;
+            return 1;
+        }
+        cout << "Perfil guardado en " << RUTA_PERFIL << endl;
+        return 0;
+    }
+
+    // "--verificar-concurrencia N [simultaneas]": decodifica el caso N veces en
+    // paralelo y compara con la ejecución secuencial
+    if (accion && strcmp(accion, "--verificar-concurrencia") == 0) {
+        int total = nNumeros > 0 ? static_cast<int>(numeros[0]) : 200;
+        int simultaneas = nNumeros > 1 ? static_cast<int>(numeros[1])
+                                       : 2 * QThread::idealThreadCount();
+        int distintas = verificarConcurrencia(".", total, simultaneas);
+        if (distintas < 0)
+            return 1;
+        cout << "Concurrencia: " << total << " decodificaciones, " << distintas
+             << " distintas de la referencia secuencial." << endl;
+        return distintas == 0 ? 0 : 1;
+    }
+
+    // "--verificar-simplificacion": prueba de simplificarCadena
+    if (accion && strcmp(accion, "--verificar-simplificacion") == 0)
+        return verificarSimplificacion() == 0 ? 0 : 1;
+
+    // "--lote carpeta1 carpeta2 ...": decodifica varios casos en paralelo
+    // "--memoria MiB" (después de --lote) fija el presupuesto de memoria.
+    if (accion && strcmp(accion, "--lote") == 0) {
+        int fallidos = procesarLote(argv + primeraCarpeta, argc - primeraCarpeta,
+                                    QThread::idealThreadCount(), presupuesto);
+        return fallidos == 0 ? 0 : 1;
+    }
+
+    // "--sondear carpeta1 carpeta2 ...": metadatos de cada caso sin decodificar
+    if (accion && strcmp(accion, "--sondear") == 0) {
+        QElapsedTimer reloj;
+        reloj.start();
+        int problemas = 0;
+        for (int i = primeraCarpeta; i < argc; ++i) {
+            int sonda[SONDA_TOTAL];
+            sondearCaso(argv[i], sonda);
+            cout << argv[i] << ": P3 " << sonda[SONDA_ANCHO] << "x" << sonda[SONDA_ALTO]
+                 << " (" << sonda[SONDA_BITS] << " bits), I_M " << sonda[SONDA_ANCHO_RUIDO]
+                 << "x" << sonda[SONDA_ALTO_RUIDO] << " (" << sonda[SONDA_BITS_RUIDO]
+                 << " bits), M " << sonda[SONDA_ANCHO_M] << "x" << sonda[SONDA_ALTO_M] << " ("
+                 << sonda[SONDA_BITS_M] << " bits), M1 semilla " << sonda[SONDA_SEMILLA_1]
+                 << " tripletas " << sonda[SONDA_TRIPLETAS_1] << ", M2 semilla "
+                 << sonda[SONDA_SEMILLA_2] << " tripletas " << sonda[SONDA_TRIPLETAS_2];
+            // Mismas condiciones que se exigen al decodificar
+            long long bytes = 3LL * sonda[SONDA_ANCHO] * sonda[SONDA_ALTO];
+            long long bytesMascara = 3LL * sonda[SONDA_ANCHO_M] * sonda[SONDA_ALTO_M];
+            bool bien = sonda[SONDA_ANCHO] > 0 && sonda[SONDA_ANCHO_M] > 0 &&
+                        sonda[SONDA_ANCHO] == sonda[SONDA_ANCHO_RUIDO] &&
+                        sonda[SONDA_ALTO] == sonda[SONDA_ALTO_RUIDO];
+            for (int m = 0; m < 2 && bien; ++m) {
+                int semilla = sonda[m == 0 ? SONDA_SEMILLA_1 : SONDA_SEMILLA_2];
+                int tripletas = sonda[m == 0 ? SONDA_TRIPLETAS_1 : SONDA_TRIPLETAS_2];
+                bien = semilla >= 0 && 3LL * tripletas >= bytesMascara &&
+                       semilla + bytesMascara <= bytes;
+            }
+            cout << (bien ? "" : " [inconsistente]") << endl;
+            if (!bien)
+                ++problemas;
+        }
+        cout << argc - primeraCarpeta << " casos sondeados en " << reloj.nsecsElapsed() / 1000000.0
+             << " ms, " << problemas << " inconsistentes." << endl;
+        return problemas == 0 ? 0 : 1;
+    }
+
+    // "--generar-sumas": escribe el archivo de suma de cada imagen de entrada
+    // (P3.bmp.sum, I_M.bmp.sum, M.bmp.sum) para detectar corrupción después.
+    if (accion && strcmp(accion, "--generar-sumas") == 0) {
+        const char* imagenes[] = { "P3.bmp", "I_M.bmp", "M.bmp" };
+        for (int i = 0; i < 3; ++i) {
+            int wi = 0, hi = 0;
+            unsigned long long suma = 0;
+            unsigned char* pix = loadPixels(QString(imagenes[i]), wi, hi, suma);
+            if (!pix)
+                continue;
+            liberarPixeles(pix);
+            string ruta = string(imagenes[i]) + ".sum";
+            ofstream f(ruta.c_str());
+            f << hex << suma << "\n";
+            cout << ruta << ": " << hex << suma << dec << endl;
+        }
+        return 0;
+    }
+
+    // Caché de resultados: si las entradas del caso ya se procesaron (mismo
+    // contenido y misma cadena) y la imagen resultante sigue en disco sin
+    // cambios, se informa sin decodificar. Solo aplica a la decodificación normal.
+    const char* RUTA_CACHE = "cache_desafio.txt";
+    bool usarCache = !accion && !sinCache && !validarMascaras;
+    unsigned long long clave = 0;
+    if (usarCache) {
+        const char* entradas[15] = { "P3.bmp", "M.bmp", "M1.txt", "M2.txt", "I_M.bmp" };
+        int nEntradas = semillaPrng < 0 ? 5 : 4;
+        // Con más archivos de los que caben en la clave no se usa caché
+        if (nEntradas + finRuidos - inicioRuidos > 15)
+            usarCache = false;
+        for (int j = inicioRuidos; j < finRuidos && usarCache; ++j)
+            entradas[nEntradas++] = argv[j];
+        long long datosCadena[3 + 16 * CAMPOS_PASO];
+        datosCadena[0] = VERSION_CADENA;
+        datosCadena[1] = semillaPrng;
+        datosCadena[2] = nPasos;
+        for (int j = 0; j < nPasos * CAMPOS_PASO; ++j)
+            datosCadena[3 + j] = cadena[j];
+        long long extra = static_cast<long long>(hashBytes(
+            reinterpret_cast<const unsigned char*>(datosCadena), 8LL * (3 + nPasos * CAMPOS_PASO)));
+        clave = usarCache ? claveCaso(entradas, nEntradas, extra) : 0;
+        char rutaSalida[256];
+        int enCache[16 * CAMPOS_PASO];
+        int nEnCache = 0;
+        if (clave != 0 && buscarEnCache(RUTA_CACHE, clave, rutaSalida, sizeof(rutaSalida),
+                                        enCache, nEnCache, 16)) {
+            cout << "Caso ya procesado (cache): " << rutaSalida << endl;
+            for (int j = 0; j < nEnCache; ++j)
+                imprimirPaso(enCache + j * CAMPOS_PASO);
+            return 0;
+        }
+    }
+
     // Cargar imagen principal (P3.bmp)
     int w = 0, h = 0;
     unsigned char* img = loadPixels(QString("P3.bmp"), w, h);
     if (!img) return 1;
 
     // Cargar imagen de distorsión (I_M.bmp)
-    int w2 = 0, h2 = 0;
-    unsigned char* imRand = loadPixels(QString("I_M.bmp"), w2, h2);
-    if (!imRand) {
-        delete [] img;
-        return 1;
+    int w2 = w, h2 = h;
+    unsigned char* imRand = nullptr;
+    if (semillaPrng < 0) {
+        imRand = loadPixels(QString("I_M.bmp"), w2, h2);
+        if (!imRand) {
+            liberarPixeles(img);
+            return 1;
+        }
     }
     if (w != w2 || h != h2) {
         cerr << "Error: Las imagenes deben tener las mismas dimensiones." << endl;
-        delete [] img;
-        delete [] imRand;
+        liberarPixeles(img);
+        liberarPixeles(imRand);
         return 1;
     }
 
+    // Biblioteca de ruido: I_M.bmp (id 0) y las imágenes indicadas después de
+    // "--ruidos" en la línea de comandos.
+    int dataSize = w * h * 3; // Total en bytes de la imagen
+    unsigned char* ruidos[MAX_RUIDOS];
+    unsigned long long hashesRuido[MAX_RUIDOS];
+    int indiceRuido[TAM_INDICE_RUIDO];
+    for (int i = 0; i < TAM_INDICE_RUIDO; ++i)
+        indiceRuido[i] = -1;
+    int nRuidos = 0;
+    if (imRand)
+        agregarRuido(imRand, dataSize, ruidos, hashesRuido, indiceRuido, nRuidos);
+    for (int j = inicioRuidos; j < finRuidos; ++j) {
+        int wr = 0, hr = 0;
+        unsigned char* extra = loadPixels(QString(argv[j]), wr, hr);
+        if (!extra)
+            continue;
+        if (wr != w || hr != h || nRuidos >= MAX_RUIDOS) {
+            cerr << "Ruido descartado (dimensiones o limite): " << argv[j] << endl;
+            liberarPixeles(extra);
+            continue;
+        }
+        int id = agregarRuido(extra, dataSize, ruidos, hashesRuido, indiceRuido, nRuidos);
+        if (ruidos[id] != extra)
+            liberarPixeles(extra); // Contenido repetido
+        cout << "Ruido " << id << ": " << argv[j] << endl;
+    }
+
     // Cargar imagen máscara (M.bmp)
     int mi = 0, mj = 0;
     unsigned char* mask = loadPixels(QString("M.bmp"), mi, mj);
     if (!mask) {
-        delete [] img;
-        delete [] imRand;
+        liberarPixeles(img);
+        liberarRuidos(ruidos, nRuidos);
         return 1;
     }
     int totalMaskBytes = mi * mj * 3; // Total de bytes de la máscara
 
     // Cargar datos de enmascaramiento desde archivos de texto
     int seed1 = 0, n1 = 0;
-    unsigned int* S1 = loadSeedMasking("M1.txt", seed1, n1);
+    unsigned char* S1 = loadSeedMasking("M1.txt", seed1, n1, mask, totalMaskBytes,
+                                        validarMascaras);
     if (!S1) {
-        delete [] img;
-        delete [] imRand;
-        delete [] mask;
+        liberarPixeles(img);
+        liberarRuidos(ruidos, nRuidos);
+        liberarPixeles(mask);
         return 1;
     }
     int seed2 = 0, n2 = 0;
-    unsigned int* S2 = loadSeedMasking("M2.txt", seed2, n2);
+    unsigned char* S2 = loadSeedMasking("M2.txt", seed2, n2, mask, totalMaskBytes,
+                                        validarMascaras);
     if (!S2) {
-        delete [] img;
-        delete [] imRand;
-        delete [] mask;
+        liberarPixeles(img);
+        liberarRuidos(ruidos, nRuidos);
+        liberarPixeles(mask);
         delete [] S1;
         return 1;
     }
 
-    int dataSize = w * h * 3; // Total en bytes de la imagen
-
     // ========================================================
     // Se aplican las operaciones inversas.
     // El orden y la forma de aplicar cada paso dependerán de
     // cómo se aplicaron originalmente las transformaciones.
     // ========================================================
+    // Paso 3 inverso: XOR con imRand a toda la imagen.
+    // Paso 2 inverso: desenmascarar con S2 y rotar a la izquierda 3 bits.
+    // Paso 1 inverso: desenmascarar con S1 y aplicar XOR con imRand.
+    unsigned char* S[2] = { S1, S2 };
+    int semillas[2] = { seed1, seed2 };
+    int nPix[2] = { n1, n2 };
 
-    // Paso 3 inverso: Aplicar XOR con imRand a toda la imagen
-    if (dataSize > 0 && (w2 * h2 * 3 == dataSize)) {
-        for (int i = 0; i < dataSize; ++i) {
-            img[i] = bxor(img[i], imRand[i]);
+    // "--descubrir" deduce la cadena desde los datos de enmascaramiento en
+    // lugar de usar la cadena fija de este caso, y la imprime.
+    // "--descubrir-tabla" hace lo mismo consultando la tabla de pares.
+    if (accion && strncmp(accion, "--descubrir", 11) == 0) {
+        unsigned long long* tabla = nullptr;
+        if (strcmp(accion, "--descubrir-tabla") == 0)
+            tabla = construirTablaPares();
+        int descubierta[16 * CAMPOS_PASO];
+        int n = descubrirCadena(img, dataSize, ruidos, nRuidos, semillaPrng, totalMaskBytes, S,
+                                semillas, nPix, 2, tabla, descubierta, 16);
+        delete [] tabla;
+        if (n > 0) {
+            cout << "Cadena descubierta:" << endl;
+            for (int j = 0; j < n; ++j)
+                imprimirPaso(descubierta + j * CAMPOS_PASO);
+            n = guardarDescubierta(rutaCadena, descubierta, n, 16);
         }
-        cout << "Paso 3 inverso: XOR aplicado(con im rand)." << endl;
+        liberarPixeles(img);
+        liberarRuidos(ruidos, nRuidos);
+        liberarPixeles(mask);
+        delete [] S1;
+        delete [] S2;
+        return n > 0 ? 0 : 1;
     }
 
-    // Paso 2 inverso: Desenmascarar usando S2 y luego rotar a la izquierda 3 bits
-    if ((n2 * 3 >= totalMaskBytes) && ((seed2 + totalMaskBytes) <= dataSize)) {
-        desenmascarar(img, mask, S2, seed2, totalMaskBytes);
-        for (int i = 0; i < dataSize; ++i) {
-            img[i] = brotate_left(img[i], 3);
+    // "--haz K" busca la cadena con un haz de ancho K, tolerando tripletas
+    // corruptas en los archivos de enmascaramiento.
+    if (accion && strcmp(accion, "--haz") == 0) {
+        int anchoHaz = nNumeros > 0 ? static_cast<int>(numeros[0]) : 8;
+        int encontrada[16 * CAMPOS_PASO];
+        double puntaje = 0.0;
+        int n = buscarCadenaHaz(img, dataSize, ruidos, nRuidos, semillaPrng, totalMaskBytes, S,
+                                semillas, nPix, 2, anchoHaz, encontrada, 16, puntaje);
+        // La mejor cadena del haz solo se informa como resultado si pasa la
+        // verificación por ventanas o llega a UMBRAL_HAZ
+        bool exacta = false;
+        if (n > 0) {
+            int** permsHaz = prepararPermutaciones(encontrada, n, w, h);
+            exacta = verificarVentanas(img, dataSize, ruidos, encontrada, n, totalMaskBytes, S,
+                                       semillas, nPix, permsHaz) < 0;
+            liberarPermutaciones(permsHaz, n);
         }
-        cout << "Paso 2 inverso: Desenmascarado con S2 y rotacion aplicada." << endl;
-    } else {
-        cout << "S2: La  correccion no es valida." << endl;
+        if (n > 0 && (exacta || puntaje >= UMBRAL_HAZ)) {
+            cout << "Mejor cadena (coincidencia media " << puntaje * 100.0 << "%):" << endl;
+            for (int j = 0; j < n; ++j)
+                imprimirPaso(encontrada + j * CAMPOS_PASO);
+            if (!exacta)
+                cout << "Nota: la cadena no pasa la verificacion exacta (tripletas"
+                        " corruptas)." << endl;
+            n = guardarDescubierta(rutaCadena, encontrada, n, 16);
+        } else {
+            if (n > 0)
+                cout << "Ninguna cadena explica las ventanas (mejor coincidencia media "
+                     << puntaje * 100.0 << "%)." << endl;
+            n = -1;
+        }
+        liberarPixeles(img);
+        liberarRuidos(ruidos, nRuidos);
+        liberarPixeles(mask);
+        delete [] S1;
+        delete [] S2;
+        return n > 0 ? 0 : 1;
     }
 
-    // Paso 1 inverso: Desenmascarar usando S1 y luego aplicar XOR con imRand
-    if ((n1 * 3 >= totalMaskBytes) && ((seed1 + totalMaskBytes) <= dataSize)) {
-        desenmascarar(img, mask, S1, seed1, totalMaskBytes);
-        for (int i = 0; i < dataSize; ++i) {
-            img[i] = bxor(img[i], imRand[i]);
+    // Los XOR de la cadena deben referirse a ruidos cargados
+    for (int j = 0; j < nPasos; ++j) {
+        if (cadena[j * CAMPOS_PASO] == OP_XOR_RUIDO && cadena[j * CAMPOS_PASO + 2] >= nRuidos) {
+            cerr << "Error: la cadena usa el ruido " << cadena[j * CAMPOS_PASO + 2]
+                 << " y hay " << nRuidos << " cargados (ver --ruidos)." << endl;
+            liberarPixeles(img);
+            liberarRuidos(ruidos, nRuidos);
+            liberarPixeles(mask);
+            delete [] S1;
+            delete [] S2;
+            return 1;
         }
-        cout << "Paso 1 inverso: Desenmascarado con S1 y XOR aplicado." << endl;
-    } else {
-        cout << "S1: La region de correccion no es valida." << endl;
+    }
+    int** perms = prepararPermutaciones(cadena, nPasos, w, h);
+
+    // Antes de cualquier pasada sobre la imagen completa se comprueba la cadena
+    // contra todos los archivos de enmascaramiento usando solo sus ventanas.
+    int fallo = verificarVentanas(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes, S,
+                                  semillas, nPix, perms);
+    if (fallo >= 0) {
+        cout << "S" << cadena[fallo * CAMPOS_PASO + 1] + 1
+             << ": La correccion no es valida." << endl;
+        int diag[DIAG_TOTAL];
+        int nFilas = mj;
+        int* porFila = new int[nFilas > 0 ? nFilas : 1];
+        if (diagnosticarVentana(img, dataSize, ruidos, cadena, fallo, totalMaskBytes, mi * 3, S,
+                                semillas, nPix, perms, diag, porFila))
+            informarDiagnostico(diag, porFila, nFilas);
+        delete [] porFila;
+        liberarPermutaciones(perms, nPasos);
+        liberarPixeles(img);
+        liberarRuidos(ruidos, nRuidos);
+        liberarPixeles(mask);
+        delete [] S1;
+        delete [] S2;
+        return 1;
+    }
+    cout << "Verificacion por ventanas correcta (M1.txt, M2.txt)." << endl;
+
+    // Vista previa: "--muestra inicio fin" evalúa la cadena solo sobre ese rango
+    // de bytes y lo imprime, sin recorrer ni exportar la imagen completa.
+    if (accion && strcmp(accion, "--muestra") == 0) {
+        // El rango se ajusta a la imagen antes de reservar la muestra
+        long long desde = numeros[0] < 0 ? 0 : numeros[0];
+        long long hasta = numeros[1] > dataSize ? dataSize : numeros[1];
+        if (hasta < desde)
+            hasta = desde;
+        int rango[2] = { static_cast<int>(desde), static_cast<int>(hasta) };
+        int len = rango[1] - rango[0];
+        unsigned char* muestra = new unsigned char[len > 0 ? len : 1];
+        int n = evaluarRangos(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes, S,
+                              semillas, perms, rango, 1, muestra);
+        for (int k = 0; k < n; ++k)
+            cout << static_cast<int>(muestra[k]) << ((k % 3 == 2) ? "\n" : " ");
+        cout << endl;
+        delete [] muestra;
+        liberarPermutaciones(perms, nPasos);
+        liberarPixeles(img);
+        liberarRuidos(ruidos, nRuidos);
+        liberarPixeles(mask);
+        delete [] S1;
+        delete [] S2;
+        return 0;
     }
 
+    // Perfil de ajuste: el de --autotune si existe; si no, con imágenes que no
+    // caben en caché se calibra el recorrido por bloques una sola vez y se
+    // guarda para las siguientes ejecuciones. Las pequeñas usan los valores por
+    // defecto.
+    int perfil[AJ_TOTAL];
+    perfilPorDefecto(perfil);
+    if (!cargarPerfil(RUTA_PERFIL, perfil) && dataSize >= UMBRAL_CALIBRACION) {
+        calibrarPerfil(perfil, 8, false);
+        if (guardarPerfil(RUTA_PERFIL, perfil))
+            cout << "Perfil calibrado guardado en " << RUTA_PERFIL << endl;
+    }
+    int pasadas = ejecutarCadenaOptimizada(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes,
+                                           S, semillas, perms, perfil);
+    liberarPermutaciones(perms, nPasos);
+    cout << "Cadena inversa aplicada (" << nPasos << " pasos, " << pasadas
+         << " pasadas completas)." << endl;
+
     // Exportar la imagen resultante ("I_D.bmp")
     if (!exportImage(img, w, h, QString("I_D.bmp"))) {
         cerr << "Error al exportar la imagen I_D.bmp" << endl;
     } else {
         cout << "Imagen I_D.bmp exportada correctamente." << endl;
+        unsigned long long hashSalida = 0;
+        if (usarCache && clave != 0 && hashArchivo("I_D.bmp", hashSalida))
+            guardarEnCache(RUTA_CACHE, clave, hashSalida, "I_D.bmp", cadena, nPasos);
     }
 
     // Liberar memoria
-    delete [] img;
-    delete [] imRand;
-    delete [] mask;
+    liberarPixeles(img);
+    liberarRuidos(ruidos, nRuidos);
+    liberarPixeles(mask);
     delete [] S1;
     delete [] S2;
 
@@ -173,30 +1078,327 @@ int main(int argc, char *argv[])
 // Función loadPixels: Carga una imagen BMP, la convierte a formato RGB888 y copia
 // sus datos en un buffer
 unsigned char* loadPixels(QString path, int &width, int &height) {
-    QImage image(path);
-    if (image.isNull()) {
-        cerr << "Error al cargar: " << path.toStdString() << endl;
+    unsigned long long suma = 0;
+    return loadPixels(path, width, height, suma);
+}
+
+static inline unsigned int leerLE32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<unsigned int>(p[3]) << 24);
+}
+
+static bool analizarCabeceraBmp(const unsigned char* cab, int &ancho, int &alto, int &bits,
+                                int &compresion, int &inicioDatos) {
+    if (cab[0] != 'B' || cab[1] != 'M' || leerLE32(cab + 14) < 40)
+        return false;
+    inicioDatos = static_cast<int>(leerLE32(cab + 10));
+    ancho = static_cast<int>(leerLE32(cab + 18));
+    alto = static_cast<int>(leerLE32(cab + 22));
+    bits = cab[28] | (cab[29] << 8);
+    compresion = static_cast<int>(leerLE32(cab + 30));
+    return true;
+}
+
+// Revisa la cabecera contra el tamaño real del archivo. Retorna nullptr si es
+// coherente o la descripción del problema: datos que empiezan dentro de la
+// cabecera o después del final, medidas fuera de rango o (sin compresión)
+// más filas de las que caben en el archivo.
+static const char* problemaCabeceraBmp(int ancho, int alto, int bits, int compresion,
+                                       int inicioDatos, long long tamArchivo) {
+    if (inicioDatos < 54 || inicioDatos >= tamArchivo)
+        return "inicio de datos fuera del archivo";
+    if (ancho <= 0 || ancho > 65535 || alto == 0 || alto < -65535 || alto > 65535 ||
+        bits <= 0 || bits > 32)
+        return "medidas invalidas";
+    if (compresion != 0)
+        return nullptr;
+    long long paso = (static_cast<long long>(ancho) * bits + 31) / 32 * 4;
+    long long filas = alto < 0 ? -alto : alto;
+    if (paso * filas > tamArchivo - inicioDatos)
+        return "faltan filas";
+    return nullptr;
+}
+
+bool leerCabeceraBmp(const char* ruta, int &ancho, int &alto, int &bits, int &compresion,
+                     int &inicioDatos, long long &tamArchivo) {
+    ifstream f(ruta, ios::binary);
+    if (!f)
+        return false;
+    unsigned char cab[54];
+    f.read(reinterpret_cast<char*>(cab), 54);
+    if (f.gcount() < 54 || !analizarCabeceraBmp(cab, ancho, alto, bits, compresion, inicioDatos))
+        return false;
+    f.seekg(0, ios::end);
+    tamArchivo = static_cast<long long>(f.tellg());
+    return problemaCabeceraBmp(ancho, alto, bits, compresion, inicioDatos, tamArchivo) == nullptr;
+}
+
+// -----------------------------------------------------------------------------
+// Función cargarBmpNativo: Lee un BMP de 24 bits sin compresión directamente
+// del archivo, por tiras de filas de a lo sumo TIRA_BMP bytes, así que además
+// del buffer de salida solo está viva una tira. Cada fila se copia invirtiendo
+// BGR a RGB y, mientras sigue en
+// caché, se pasan al hash los bloques de 32 bytes ya completos del buffer de
+// salida: la suma no requiere otra pasada por memoria. Retorna nullptr sin
+// mensaje si el formato no es ese (el llamador recurre a QImage) y con
+// mensaje si el archivo está truncado o mal formado.
+static unsigned char* cargarBmpNativo(const char* ruta, int &width, int &height,
+                                      unsigned long long &suma, bool &noSoportado) {
+    noSoportado = true;
+    ifstream f(ruta, ios::binary);
+    if (!f)
+        return nullptr;
+    unsigned char cab[54];
+    f.read(reinterpret_cast<char*>(cab), 54);
+    int inicioDatos = 0, ancho = 0, alto = 0, bits = 0, compresion = 0;
+    if (f.gcount() < 54 || !analizarCabeceraBmp(cab, ancho, alto, bits, compresion, inicioDatos))
+        return nullptr;
+    if (bits != 24 || compresion != 0)
+        return nullptr;
+    noSoportado = false;
+    f.seekg(0, ios::end);
+    long long tamArchivo = static_cast<long long>(f.tellg());
+    const char* problema = problemaCabeceraBmp(ancho, alto, bits, compresion, inicioDatos,
+                                               tamArchivo);
+    if (problema) {
+        cerr << "Cabecera BMP invalida: " << ruta << " (" << problema << ", "
+             << tamArchivo << " bytes)" << endl;
         return nullptr;
     }
-    image = image.convertToFormat(QImage::Format_RGB888);
-    width = image.width();
-    height = image.height();
-    int size = width * height * 3;
-    unsigned char* buf = new unsigned char[size];
-    // Inicialización a cero usando un bucle
-    for (int i = 0; i < size; ++i) {
-        buf[i] = 0;
+    bool abajoArriba = alto > 0;
+    if (alto < 0)
+        alto = -alto;
+    int bytesFila = ancho * 3;
+    int paso = (bytesFila + 3) & ~3; // Las filas del BMP se rellenan a 4 bytes
+    long long size = static_cast<long long>(bytesFila) * alto;
+    // Las filas se toman en el orden del buffer de salida (de arriba hacia
+    // abajo), así el hash avanza junto con la copia. Las filas de una tira son
+    // contiguas en el archivo también en un BMP de abajo hacia arriba (en orden
+    // inverso), así que cada tira se lee con una sola lectura.
+    int filasTira = TIRA_BMP / paso > 0 ? TIRA_BMP / paso : 1;
+    if (filasTira > alto)
+        filasTira = alto;
+    unsigned char* tira = new unsigned char[static_cast<long long>(paso) * filasTira];
+    unsigned char* buf = reservarPixeles(size);
+    unsigned long long estado[4];
+    hashIniciar(estado);
+    long long hashHasta = 0;
+    for (int y0 = 0; y0 < alto; y0 += filasTira) {
+        int n = alto - y0 < filasTira ? alto - y0 : filasTira;
+        long long primeraFila = abajoArriba ? alto - y0 - n : y0;
+        long long bytesTira = static_cast<long long>(paso) * n;
+        f.seekg(inicioDatos + primeraFila * paso);
+        f.read(reinterpret_cast<char*>(tira), bytesTira);
+        if (f.gcount() != bytesTira) {
+            cerr << "Archivo truncado: " << ruta << " (fila " << y0 << " de " << alto
+                 << ")" << endl;
+            delete [] tira;
+            liberarPixeles(buf);
+            return nullptr;
+        }
+        for (int k = 0; k < n; ++k) {
+            int y = y0 + k;
+            const unsigned char* fila = tira + static_cast<long long>(abajoArriba ? n - 1 - k : k) * paso;
+            unsigned char* out = buf + static_cast<long long>(y) * bytesFila;
+            for (int i = 0; i < bytesFila; i += 3) {
+                out[i] = fila[i + 2];
+                out[i + 1] = fila[i + 1];
+                out[i + 2] = fila[i];
+            }
+            // Bloques de 32 bytes completos hasta el final de esta fila
+            long long listos = (static_cast<long long>(y + 1) * bytesFila - hashHasta) & ~31LL;
+            hashBloques(estado, buf + hashHasta, listos);
+            hashHasta += listos;
+        }
     }
-    for (int y = 0; y < height; ++y) {
-        const uchar* line = image.scanLine(y);
-        int offset = y * width * 3;
-        for (int i = 0; i < width * 3; ++i) {
-            buf[offset + i] = line[i];
+    delete [] tira;
+    suma = hashFinal(estado, buf + hashHasta, static_cast<int>(size - hashHasta), size);
+    width = ancho;
+    height = alto;
+    return buf;
+}
+
+unsigned char* loadPixels(QString path, int &width, int &height, unsigned long long &suma) {
+    string ruta = path.toStdString();
+    bool noSoportado = false;
+    unsigned char* buf = cargarBmpNativo(ruta.c_str(), width, height, suma, noSoportado);
+    if (!buf && !noSoportado)
+        return nullptr;
+    if (!buf) {
+        // Otros formatos (8 bits, con paleta, comprimidos): se usa QImage
+        QImage image(path);
+        if (image.isNull()) {
+            cerr << "Error al cargar: " << ruta << endl;
+            return nullptr;
         }
+        image = image.convertToFormat(QImage::Format_RGB888);
+        width = image.width();
+        height = image.height();
+        int size = width * height * 3;
+        buf = reservarPixeles(size);
+        for (int y = 0; y < height; ++y) {
+            const uchar* line = image.scanLine(y);
+            memcpy(buf + y * width * 3, line, width * 3);
+        }
+        suma = hashBytes(buf, size);
+    }
+
+    // Suma esperada opcional en "<path>.sum"
+    ifstream fs((ruta + ".sum").c_str());
+    unsigned long long esperada = 0;
+    if (fs >> hex >> esperada && esperada != suma) {
+        cerr << "Suma de verificacion incorrecta: " << ruta << " (esperada " << hex
+             << esperada << ", calculada " << suma << dec << ")" << endl;
+        liberarPixeles(buf);
+        return nullptr;
     }
     return buf;
 }
 
+// -----------------------------------------------------------------------------
+// Función reservarPixeles: Cada buffer lleva antes de los datos una cabecera
+// de 64 bytes con el tamaño reservado y cómo se reservó, para que
+// liberarPixeles sepa si usar free o munmap. Los datos quedan alineados a 64.
+unsigned char* reservarPixeles(long long bytes, int modo) {
+    const long long CABECERA = 64;
+    const long long PAGINA_GRANDE = 2LL << 20;
+    long long total = (bytes > 0 ? bytes : 1) + CABECERA;
+    long long tamGrande = (total + PAGINA_GRANDE - 1) & ~(PAGINA_GRANDE - 1);
+    void* base = nullptr;
+    long long tipo = 0; // 0: free, 1: munmap
+    if (modo == PAGINAS_AUTO)
+        modo = total >= UMBRAL_PAGINAS_GRANDES ? PAGINAS_HUGETLB : PAGINAS_NORMALES;
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+    if (modo == PAGINAS_HUGETLB) {
+        // Solo funciona si el sistema tiene páginas reservadas (vm.nr_hugepages)
+        void* p = mmap(nullptr, tamGrande, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            base = p;
+            total = tamGrande;
+            tipo = 1;
+        }
+    }
+#endif
+    if (!base && modo != PAGINAS_NORMALES) {
+        if (posix_memalign(&base, PAGINA_GRANDE, tamGrande) != 0)
+            base = nullptr;
+#ifdef MADV_HUGEPAGE
+        if (base)
+            madvise(base, tamGrande, MADV_HUGEPAGE);
+#endif
+    }
+#endif
+    if (!base && posix_memalign(&base, CABECERA, total) != 0)
+        throw bad_alloc();
+    long long* cab = static_cast<long long*>(base);
+    cab[0] = total;
+    cab[1] = tipo;
+    return static_cast<unsigned char*>(base) + CABECERA;
+}
+
+void liberarPixeles(unsigned char* datos) {
+    if (!datos)
+        return;
+    unsigned char* base = datos - 64;
+    long long* cab = reinterpret_cast<long long*>(base);
+#ifdef __linux__
+    if (cab[1] == 1) {
+        munmap(base, cab[0]);
+        return;
+    }
+#endif
+    free(base);
+}
+
+#ifdef __linux__
+// Abre el contador de fallos de lectura en el TLB de datos del proceso.
+// Retorna -1 si el sistema no lo permite (perf_event_paranoid, contenedores).
+static int abrirContadorTlb() {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// Función medirPaginas: Arma un caso sintético (imagen, ruido y los residuos
+// de dos archivos de enmascaramiento de media imagen) y ejecuta la cadena
+// inversa de referencia con ejecutarCadenaOptimizada, el mismo camino que la
+// decodificación, con los buffers reservados en cada tipo de páginas.
+void medirPaginas(int megas) {
+    if (megas < 1)
+        megas = 1;
+    if (megas > 1024)
+        megas = 1024;
+    int dataSize = (megas << 20) / 3 * 3;
+    int totalMaskBytes = dataSize / 2;
+    int semillas[2] = { dataSize / 4, dataSize / 8 };
+    const int cadena[] = { OP_XOR_RUIDO, 0, 0, OP_DESENMASCARAR, 1, 0, OP_ROT_IZQ, 3, 0,
+                           OP_DESENMASCARAR, 0, 0, OP_XOR_RUIDO, 0, 0 };
+    int* perms[5] = { nullptr, nullptr, nullptr, nullptr, nullptr };
+    const char* nombres[] = { "normales", "THP", "hugetlb" };
+    const int REPETICIONES = 5;
+    cout << "Cadena de 5 pasos sobre " << megas << " MiB, " << REPETICIONES
+         << " repeticiones" << endl;
+    for (int modo = PAGINAS_NORMALES; modo <= PAGINAS_HUGETLB; ++modo) {
+        unsigned char* img = reservarPixeles(dataSize, modo);
+        unsigned char* ruido = reservarPixeles(dataSize, modo);
+        unsigned char* S[2];
+        for (int i = 0; i < dataSize; ++i) {
+            img[i] = static_cast<unsigned char>(palabraPrng(1, i));
+            ruido[i] = static_cast<unsigned char>(palabraPrng(2, i));
+        }
+        for (int m = 0; m < 2; ++m) {
+            S[m] = reservarPixeles(totalMaskBytes, modo);
+            for (int k = 0; k < totalMaskBytes; ++k)
+                S[m][k] = static_cast<unsigned char>(palabraPrng(m + 7, k));
+        }
+        const unsigned char* ruidos[1] = { ruido };
+        int contador = -1;
+#ifdef __linux__
+        contador = abrirContadorTlb();
+        if (contador >= 0) {
+            ioctl(contador, PERF_EVENT_IOC_RESET, 0);
+            ioctl(contador, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+        QElapsedTimer reloj;
+        reloj.start();
+        for (int r = 0; r < REPETICIONES; ++r)
+            ejecutarCadenaOptimizada(img, dataSize, ruidos, cadena, 5, totalMaskBytes, S,
+                                     semillas, perms);
+        double segundos = reloj.nsecsElapsed() * 1e-9;
+        long long fallos = -1;
+#ifdef __linux__
+        if (contador >= 0) {
+            ioctl(contador, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(contador, &fallos, sizeof(fallos)) != sizeof(fallos))
+                fallos = -1;
+            close(contador);
+        }
+#endif
+        double mbs = static_cast<double>(dataSize) * REPETICIONES / segundos / (1 << 20);
+        cout << "  Paginas " << nombres[modo] << ": " << segundos * 1000 / REPETICIONES
+             << " ms por cadena, " << mbs << " MiB/s, fallos dTLB: ";
+        if (fallos >= 0)
+            cout << fallos << endl;
+        else
+            cout << "n/d" << endl;
+        liberarPixeles(img);
+        liberarPixeles(ruido);
+        liberarPixeles(S[0]);
+        liberarPixeles(S[1]);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // Función exportImage: Guarda un buffer de datos RGB en un archivo BMP.
 bool exportImage(unsigned char* data, int width, int height, QString path) {
@@ -211,31 +1413,3434 @@ bool exportImage(unsigned char* data, int width, int height, QString path) {
     return out.save(path, "BMP");
 }
 
+#ifdef DESAFIO_X86
+// Máscara de 64 bits con los bytes de p[0..64) que son dígitos: (c - '0')
+// como entero sin signo es <= 9 solo para los dígitos.
+static inline unsigned long long mascaraDigitosSse2(const unsigned char* p) {
+    __m128i cero = _mm_set1_epi8('0');
+    __m128i nueve = _mm_set1_epi8(9);
+    unsigned long long m = 0;
+    for (int k = 0; k < 4; ++k) {
+        __m128i v = _mm_sub_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k)), cero);
+        __m128i digito = _mm_cmpeq_epi8(_mm_min_epu8(v, nueve), v);
+        m |= static_cast<unsigned long long>(
+                 static_cast<unsigned int>(_mm_movemask_epi8(digito)) & 0xFFFF) << (16 * k);
+    }
+    return m;
+}
+
+__attribute__((target("avx2")))
+static unsigned long long mascaraDigitosAvx2(const unsigned char* p) {
+    __m256i cero = _mm256_set1_epi8('0');
+    __m256i nueve = _mm256_set1_epi8(9);
+    unsigned long long m = 0;
+    for (int k = 0; k < 2; ++k) {
+        __m256i v = _mm256_sub_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * k)), cero);
+        __m256i digito = _mm256_cmpeq_epi8(_mm256_min_epu8(v, nueve), v);
+        m |= static_cast<unsigned long long>(
+                 static_cast<unsigned int>(_mm256_movemask_epi8(digito))) << (32 * k);
+    }
+    return m;
+}
+#endif
+
+static inline unsigned long long mascaraDigitos(const unsigned char* p, bool avx2) {
+#ifdef DESAFIO_X86
+    return avx2 ? mascaraDigitosAvx2(p) : mascaraDigitosSse2(p);
+#else
+    (void)avx2;
+    unsigned long long m = 0;
+    for (int k = 0; k < 64; ++k)
+        m |= static_cast<unsigned long long>(p[k] >= '0' && p[k] <= '9') << k;
+    return m;
+#endif
+}
+
 // -----------------------------------------------------------------------------
 // Función loadSeedMasking: Lee la semilla y los tripletes RGB desde un archivo de texto.
 // La semilla se encuentra en la primera línea; luego se leen enteros para cada triplete RGB.
-unsigned int* loadSeedMasking(const char* file, int &seed, int &n_pixels) {
-    ifstream f(file);
+// Carga perezosa: el desenmascaramiento solo usa los primeros totalMaskBytes
+// valores, así que el archivo se lee en trozos de 1 MiB y se deja de leer al
+// tener los necesarios. Cada valor se guarda ya restado de la máscara, como
+// residuo de un byte. Cada trozo se procesa en dos etapas, como los lectores de
+// JSON vectorizados:
+// 1. Indexado: por cada bloque de 64 bytes se arma con SIMD la máscara de
+//    dígitos y de ella la de inicios de número (un dígito cuyo byte anterior
+//    no lo es).
+// 2. Extracción: se recorren los bits de inicio; la longitud de cada número
+//    sale de la máscara de dígitos y los de 1 a 3 dígitos se convierten sin
+//    saltos condicionales (d0 * m0 + d1 * m1 + d2 * m2 con multiplicadores
+//    según la longitud).
+// Cualquier byte que no sea dígito separa números. El último bloque de 64
+// bytes se arrastra al trozo siguiente para que la longitud de un número que
+// cruza el borde se vea entera.
+unsigned char* loadSeedMasking(const char* file, int &seed, int &n_pixels,
+                               const unsigned char* mask, int valoresNecesarios,
+                               bool validarResto) {
+    ifstream f(file, ios::binary);
     if (!f) {
         cerr << "Error al abrir " << file << endl;
         return nullptr;
     }
-    f >> seed;
-    n_pixels = 0;
-    int r = 0, g = 0, b = 0;
-    while (f >> r >> g >> b)
-        ++n_pixels;
-    f.clear();
-    f.seekg(0);
-    f >> seed; // Releer la semilla para reposicionar el puntero
-    unsigned int* S = new unsigned int[n_pixels * 3];
-    // Inicializar S en 0 mediante bucle
-    for (int i = 0; i < n_pixels * 3; ++i)
-        S[i] = 0;
-    for (int i = 0; i < n_pixels * 3; i += 3) {
-        f >> S[i] >> S[i + 1] >> S[i + 2];
-    }
-    f.close();
+    const long long TAM_TROZO = 1LL << 20; // Múltiplo de 64
+    // Bloque arrastrado + trozo + relleno con ceros
+    unsigned char* buf = new unsigned char[64 + TAM_TROZO + 64];
+    unsigned long long* digitos = new unsigned long long[(64 + TAM_TROZO) / 64 + 1];
+    bool avx2 = varianteDisponible(VAR_AVX2);
+
+    static const unsigned int MULTIPLICADORES[4][3] = {
+        { 0, 0, 0 }, { 1, 0, 0 }, { 10, 1, 0 }, { 100, 10, 1 }
+    };
+    long long necesarios = valoresNecesarios > 0 ? valoresNecesarios : 0;
+    unsigned char* S = new unsigned char[necesarios > 0 ? necesarios : 1];
+    long long limite = 1 + necesarios;
+    seed = 0;
+    long long k = 0;               // Números vistos (el primero es la semilla)
+    bool fueraDeRango = false;
+    long long enBuf = 0;           // Bytes arrastrados al inicio de buf
+    unsigned long long previo = 0; // 1 si el último byte procesado es dígito
+    bool fin = false;
+    while (!fin && (k < limite || validarResto)) {
+        f.read(reinterpret_cast<char*>(buf + enBuf), TAM_TROZO);
+        long long total = enBuf + f.gcount();
+        fin = f.gcount() < TAM_TROZO;
+        long long nBloques = (total + 63) / 64;
+        memset(buf + total, 0, nBloques * 64 + 64 - total);
+        for (long long b = 0; b < nBloques; ++b)
+            digitos[b] = mascaraDigitos(buf + 64 * b, avx2);
+        digitos[nBloques] = 0;
+
+        // Sin llegar al final, el último bloque queda para el trozo siguiente
+        long long procesar = fin ? nBloques : nBloques - 1;
+        for (long long b = 0; b < procesar; ++b) {
+            unsigned long long m = digitos[b];
+            unsigned long long w = m & ~((m << 1) | previo);
+            previo = m >> 63;
+            if (k >= limite && !validarResto)
+                break;
+            while (w) {
+                int pos = __builtin_ctzll(w);
+                w &= w - 1;
+                unsigned long long resto = pos ? (m >> pos) | (digitos[b + 1] << (64 - pos)) : m;
+                int largo = __builtin_ctzll(~resto);
+                const unsigned char* p = buf + 64 * b + pos;
+                unsigned int v;
+                if (largo <= 3) {
+                    const unsigned int* mult = MULTIPLICADORES[largo];
+                    v = (p[0] - '0') * mult[0] + (p[1] - '0') * mult[1] + (p[2] - '0') * mult[2];
+                } else {
+                    v = 0;
+                    for (int d = 0; d < largo; ++d)
+                        v = v * 10 + (p[d] - '0');
+                }
+                if (k == 0)
+                    seed = static_cast<int>(v);
+                else if (k < limite)
+                    S[k - 1] = static_cast<unsigned char>(v - mask[k - 1]);
+                else if (largo > 3 || v > 510)
+                    fueraDeRango = true;
+                ++k;
+            }
+        }
+        if (!fin) {
+            enBuf = total - 64 * (nBloques - 1);
+            memmove(buf, buf + 64 * (nBloques - 1), enBuf);
+        }
+    }
+    delete [] digitos;
+    delete [] buf;
+
+    long long guardados = k < limite ? k : limite;
+    n_pixels = guardados > 0 ? static_cast<int>((guardados - 1) / 3) : 0;
+    if (validarResto && (fueraDeRango || (k > 0 && (k - 1) % 3 != 0))) {
+        cerr << file << ": el resto del archivo no es valido ("
+             << (fueraDeRango ? "valores fuera de rango" : "tripleta incompleta") << ")." << endl;
+        delete [] S;
+        return nullptr;
+    }
     return S;
 }
 
+// -----------------------------------------------------------------------------
+// Función aplicarPaso: Aplica una operación a nivel de bits sobre un rango de
+// bytes. Todas las operaciones son locales al byte: el resultado en la posición
+// i solo depende del byte i de la imagen (y del byte i del ruido para el XOR).
+void aplicarPaso(unsigned char* datos, int base, int len,
+                 const unsigned char* const* ruidos, int tamRuido, const int* paso) {
+    int tipo = paso[0];
+    int k = paso[1];
+    if (tipo == OP_XOR_RUIDO) {
+        const unsigned char* imRand = ruidos[paso[2]];
+        if (k == 0) {
+            for (int i = 0; i < len; ++i)
+                datos[i] = bxor(datos[i], imRand[base + i]);
+            return;
+        }
+        // Ruido desplazado k bytes con vuelta al inicio: se recorre por tramos
+        // contiguos de imRand en lugar de calcular el módulo en cada byte o
+        // materializar una copia desplazada del ruido.
+        int pos = static_cast<int>(((static_cast<long long>(base) + k) % tamRuido
+                                    + tamRuido) % tamRuido);
+        int i = 0;
+        while (i < len) {
+            int tramo = tamRuido - pos < len - i ? tamRuido - pos : len - i;
+            const unsigned char* ruido = imRand + pos;
+            for (int j = 0; j < tramo; ++j)
+                datos[i + j] = bxor(datos[i + j], ruido[j]);
+            i += tramo;
+            pos = 0;
+        }
+    } else if (tipo == OP_ROT_IZQ) {
+        for (int i = 0; i < len; ++i)
+            datos[i] = brotate_left(datos[i], k);
+    } else if (tipo == OP_ROT_DER) {
+        for (int i = 0; i < len; ++i)
+            datos[i] = brotate_left(datos[i], 8 - (k & 7));
+    } else if (tipo == OP_DESP_IZQ) {
+        for (int i = 0; i < len; ++i)
+            datos[i] = static_cast<unsigned char>((datos[i] << k) & 0xFF);
+    } else if (tipo == OP_DESP_DER) {
+        for (int i = 0; i < len; ++i)
+            datos[i] = static_cast<unsigned char>(datos[i] >> k);
+    } else if (tipo == OP_XOR_CONST) {
+        for (int i = 0; i < len; ++i)
+            datos[i] = bxor(datos[i], static_cast<unsigned char>(k));
+    } else if (tipo == OP_XOR_PRNG && paso[2] == PRNG_SPLITMIX64) {
+        // El flujo se genera al vuelo dentro del mismo recorrido: no se lee
+        // ninguna imagen de ruido, solo la imagen. Los bytes hasta la primera
+        // palabra completa y los del final se tratan uno por uno; el resto se
+        // procesa de a 8 bytes con un XOR de 64 bits.
+        unsigned long long semilla = static_cast<unsigned int>(k);
+        int i = 0;
+        while (i < len && (base + i) % 8 != 0) {
+            long long pos = static_cast<long long>(base) + i;
+            datos[i] ^= static_cast<unsigned char>(palabraPrng(semilla, pos / 8) >> (8 * (pos % 8)));
+            ++i;
+        }
+        for (; i + 8 <= len; i += 8) {
+            unsigned long long v;
+            memcpy(&v, datos + i, 8);
+            v ^= palabraPrng(semilla, (static_cast<unsigned long long>(base) + i) / 8);
+            memcpy(datos + i, &v, 8);
+        }
+        for (; i < len; ++i) {
+            long long pos = static_cast<long long>(base) + i;
+            datos[i] ^= static_cast<unsigned char>(palabraPrng(semilla, pos / 8) >> (8 * (pos % 8)));
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Función evaluarRangos: Como las operaciones a nivel de bits son locales al
+// byte, el valor final del byte i solo depende de img[i], del ruido en i y de los
+// desenmascarados cuya ventana contiene a i. Por eso la cadena se puede evaluar
+// sobre rangos sueltos con un costo proporcional a su tamaño y no al de la
+// imagen. Se usa para la verificación por ventanas, vistas previas y
+// comprobaciones puntuales.
+// Si la cadena contiene permutaciones, cada byte pedido se rastrea hacia atrás
+// a través de las tablas de origen para saber en qué posición estaba en cada
+// etapa, y luego se evalúa hacia adelante usando esa posición.
+int evaluarRangos(const unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                  const int* cadena, int nPasos, int totalMaskBytes,
+                  unsigned char** S, const int* semillas,
+                  int* const* perms, const int* rangos, int nRangos,
+                  unsigned char* salida) {
+    bool hayPermutaciones = false;
+    for (int p = 0; p < nPasos; ++p)
+        if (esPermutacion(cadena[p * CAMPOS_PASO]))
+            hayPermutaciones = true;
+    int* posiciones = hayPermutaciones ? new int[nPasos + 1] : nullptr;
+
+    int escritos = 0;
+    for (int r = 0; r < nRangos; ++r) {
+        int ini = rangos[2 * r] < 0 ? 0 : rangos[2 * r];
+        int fin = rangos[2 * r + 1] > dataSize ? dataSize : rangos[2 * r + 1];
+        if (fin <= ini)
+            continue;
+        unsigned char* datos = salida + escritos;
+        int len = fin - ini;
+        escritos += len;
+        if (hayPermutaciones) {
+            for (int k = 0; k < len; ++k) {
+                // posiciones[p] = índice del byte antes del paso p
+                int pos = ini + k;
+                posiciones[nPasos] = pos;
+                for (int p = nPasos - 1; p >= 0; --p) {
+                    if (esPermutacion(cadena[p * CAMPOS_PASO]))
+                        pos = 3 * perms[p][pos / 3] + pos % 3;
+                    posiciones[p] = pos;
+                }
+                unsigned char v = img[posiciones[0]];
+                for (int p = 0; p < nPasos; ++p) {
+                    const int* paso = cadena + p * CAMPOS_PASO;
+                    int i = posiciones[p];
+                    if (paso[0] == OP_DESENMASCARAR) {
+                        int sp = semillas[paso[1]];
+                        if (i >= sp && i < sp + totalMaskBytes)
+                            v = S[paso[1]][i - sp];
+                    } else if (!esPermutacion(paso[0])) {
+                        aplicarPaso(&v, i, 1, ruidos, dataSize, paso);
+                    }
+                }
+                datos[k] = v;
+            }
+            continue;
+        }
+        for (int k = 0; k < len; ++k)
+            datos[k] = img[ini + k];
+        for (int p = 0; p < nPasos; ++p) {
+            const int* paso = cadena + p * CAMPOS_PASO;
+            if (paso[0] != OP_DESENMASCARAR) {
+                aplicarPaso(datos, ini, len, ruidos, dataSize, paso);
+                continue;
+            }
+            // Un desenmascarado solo afecta la intersección con su ventana
+            int sp = semillas[paso[1]];
+            int a = sp > ini ? sp : ini;
+            int b = sp + totalMaskBytes < fin ? sp + totalMaskBytes : fin;
+            if (b > a)
+                memcpy(datos + (a - ini), S[paso[1]] + (a - sp), b - a);
+        }
+    }
+    delete [] posiciones;
+    return escritos;
+}
+
+// -----------------------------------------------------------------------------
+// Función verificarVentanas: Para cada paso de desenmascarado copia solo la
+// ventana img[seed .. seed + totalMaskBytes), le aplica los pasos anteriores de
+// la cadena y la compara con los residuos (S[k] - mask[k]) & 0xFF. El costo
+// depende del tamaño de la máscara y no del de la imagen, por lo que un caso
+// corrupto o mal configurado se descarta antes de hacer cualquier pasada
+// completa.
+int verificarVentanas(const unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                      const int* cadena, int nPasos, int totalMaskBytes, unsigned char** S,
+                      const int* semillas, const int* nPix, int* const* perms) {
+    if (!img || totalMaskBytes <= 0)
+        return -1;
+    unsigned char* ventana = new unsigned char[totalMaskBytes];
+    for (int j = 0; j < nPasos; ++j) {
+        const int* paso = cadena + j * CAMPOS_PASO;
+        if (paso[0] != OP_DESENMASCARAR)
+            continue;
+        int m = paso[1];
+        int seed = semillas[m];
+        if (!S[m] || seed < 0 || nPix[m] * 3 < totalMaskBytes ||
+            seed + totalMaskBytes > dataSize) {
+            delete [] ventana;
+            return j;
+        }
+        // Se reproducen los pasos previos solo sobre la ventana
+        int rango[2] = { seed, seed + totalMaskBytes };
+        evaluarRangos(img, dataSize, ruidos, cadena, j, totalMaskBytes, S,
+                      semillas, perms, rango, 1, ventana);
+        if (memcmp(ventana, S[m], totalMaskBytes) != 0) {
+            delete [] ventana;
+            return j;
+        }
+    }
+    delete [] ventana;
+    return -1;
+}
+
+// -----------------------------------------------------------------------------
+// Función compararVentana: Solo corre cuando la verificación ya falló, así que
+// no agrega costo al caso válido. Cada fila de la máscara se recorre en grupos
+// de 48 bytes que empiezan en un byte de canal R (16 píxeles, el canal de cada
+// byte es fijo dentro del grupo):
+// - x = ventana ^ residuo; los bytes distintos salen de comparar x con cero y
+//   se cuentan por canal con popcount sobre máscaras de un byte de cada tres.
+// - El bit 7 de cada byte de x sale con movemask; sumando x consigo mismo se
+//   corre un bit a la izquierda y se obtienen los demás.
+// - Para cada k se rota la ventana k bits y se cuentan los bytes iguales al
+//   residuo: si alguna rotación explica casi todo, el error está en una rotación
+//   y no en un XOR.
+static inline void compararByteVentana(unsigned char v, unsigned char r, int canal, int* diag,
+                                       int &distintos) {
+    unsigned char x = v ^ r;
+    ++diag[DIAG_BYTES];
+    if (x) {
+        ++diag[DIAG_DISTINTOS];
+        ++diag[DIAG_CANAL + canal];
+        ++distintos;
+        for (int b = 0; b < 8; ++b)
+            diag[DIAG_BIT + b] += (x >> b) & 1;
+    }
+    for (int k = 1; k < 8; ++k)
+        diag[DIAG_ROTADA + k - 1] += brotate_left(v, k) == r;
+}
+
+#ifdef DESAFIO_X86
+static void compararGrupoSse2(const unsigned char* v, const unsigned char* r, int* diag,
+                              int &distintos) {
+    const unsigned long long CANALES = 0x249249249249ULL; // Bits 0, 3, 6, ... de 48
+    __m128i cero = _mm_setzero_si128();
+    unsigned long long dif = 0;
+    for (int q = 0; q < 3; ++q) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + 16 * q));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + 16 * q));
+        __m128i x = _mm_xor_si128(a, b);
+        unsigned long long d = ~static_cast<unsigned int>(
+                                   _mm_movemask_epi8(_mm_cmpeq_epi8(x, cero))) & 0xFFFF;
+        dif |= d << (16 * q);
+        for (int bit = 7; bit >= 0; --bit) {
+            diag[DIAG_BIT + bit] += __builtin_popcount(_mm_movemask_epi8(x));
+            x = _mm_add_epi8(x, x);
+        }
+        for (int k = 1; k < 8; ++k) {
+            __m128i izq = _mm_and_si128(_mm_sll_epi16(a, _mm_cvtsi32_si128(k)),
+                                        _mm_set1_epi8(static_cast<char>((0xFF << k) & 0xFF)));
+            __m128i der = _mm_and_si128(_mm_srl_epi16(a, _mm_cvtsi32_si128(8 - k)),
+                                        _mm_set1_epi8(static_cast<char>(0xFF >> (8 - k))));
+            __m128i igual = _mm_cmpeq_epi8(_mm_or_si128(izq, der), b);
+            diag[DIAG_ROTADA + k - 1] += __builtin_popcount(_mm_movemask_epi8(igual));
+        }
+    }
+    diag[DIAG_BYTES] += 48;
+    int n = __builtin_popcountll(dif);
+    diag[DIAG_DISTINTOS] += n;
+    distintos += n;
+    for (int c = 0; c < 3; ++c)
+        diag[DIAG_CANAL + c] += __builtin_popcountll(dif & (CANALES << c));
+}
+#endif
+
+void compararVentana(const unsigned char* ventana, const unsigned char* residuos, int len,
+                     int seed, int inicio, int bytesFila, int* diag, int* porFila) {
+    if (bytesFila <= 0)
+        bytesFila = len + inicio;
+    int k = 0;
+    while (k < len) {
+        int pos = inicio + k;
+        int fila = pos / bytesFila;
+        int fin = (fila + 1) * bytesFila - inicio; // Fin de la fila dentro del tramo
+        if (fin > len)
+            fin = len;
+        int distintos = 0;
+        // Hasta el primer byte de canal R, después grupos completos y el resto
+        for (; k < fin && (seed + inicio + k) % 3 != 0; ++k)
+            compararByteVentana(ventana[k], residuos[k], (seed + inicio + k) % 3, diag,
+                                distintos);
+#ifdef DESAFIO_X86
+        for (; k + 48 <= fin; k += 48)
+            compararGrupoSse2(ventana + k, residuos + k, diag, distintos);
+#endif
+        for (; k < fin; ++k)
+            compararByteVentana(ventana[k], residuos[k], (seed + inicio + k) % 3, diag,
+                                distintos);
+        if (porFila)
+            porFila[fila] += distintos;
+    }
+}
+
+bool diagnosticarVentana(const unsigned char* img, int dataSize,
+                         const unsigned char* const* ruidos, const int* cadena, int fallo,
+                         int totalMaskBytes, int bytesFila, unsigned char** S,
+                         const int* semillas, const int* nPix, int* const* perms,
+                         int* diag, int* porFila) {
+    int m = cadena[fallo * CAMPOS_PASO + 1];
+    int seed = semillas[m];
+    if (!img || totalMaskBytes <= 0 || bytesFila <= 0 || !S[m] || seed < 0 ||
+        nPix[m] * 3 < totalMaskBytes || seed + totalMaskBytes > dataSize)
+        return false;
+    unsigned char* ventana = new unsigned char[totalMaskBytes];
+    int rango[2] = { seed, seed + totalMaskBytes };
+    evaluarRangos(img, dataSize, ruidos, cadena, fallo, totalMaskBytes, S, semillas, perms,
+                  rango, 1, ventana);
+    for (int i = 0; i < DIAG_TOTAL; ++i)
+        diag[i] = 0;
+    for (int f = 0; f < totalMaskBytes / bytesFila; ++f)
+        porFila[f] = 0;
+    compararVentana(ventana, S[m], totalMaskBytes, seed, 0, bytesFila, diag, porFila);
+    delete [] ventana;
+    return true;
+}
+
+void informarDiagnostico(const int* diag, const int* porFila, int nFilas) {
+    int bytes = diag[DIAG_BYTES], distintos = diag[DIAG_DISTINTOS];
+    if (bytes <= 0)
+        return;
+    cout << "  Bytes distintos: " << distintos << " de " << bytes << " ("
+         << 100.0 * distintos / bytes << "%)" << endl;
+    cout << "  Por canal: R " << diag[DIAG_CANAL] << ", G " << diag[DIAG_CANAL + 1]
+         << ", B " << diag[DIAG_CANAL + 2] << endl;
+    cout << "  Bits que difieren (7..0):";
+    for (int b = 7; b >= 0; --b)
+        cout << " " << diag[DIAG_BIT + b];
+    cout << endl;
+    int filasMal = 0, peor = 0;
+    for (int f = 0; f < nFilas; ++f) {
+        if (porFila[f] > 0)
+            ++filasMal;
+        if (porFila[f] > porFila[peor])
+            peor = f;
+    }
+    if (nFilas > 0)
+        cout << "  Filas de la mascara con diferencias: " << filasMal << " de " << nFilas
+             << " (peor: fila " << peor << ", " << porFila[peor] << " bytes)" << endl;
+    int mejorK = 1;
+    for (int k = 2; k < 8; ++k)
+        if (diag[DIAG_ROTADA + k - 1] > diag[DIAG_ROTADA + mejorK - 1])
+            mejorK = k;
+    int rotada = diag[DIAG_ROTADA + mejorK - 1];
+    cout << "  Mejor rotacion de la ventana: " << mejorK << " bits a la izquierda, coincide el "
+         << 100.0 * rotada / bytes << "%" << endl;
+
+    // Pistas: una rotación que explica casi todo, canales intactos, pocas filas
+    // o bits que difieren en la mitad de los bytes (ruido distinto)
+    int canalesMal = (diag[DIAG_CANAL] > 0) + (diag[DIAG_CANAL + 1] > 0) +
+                     (diag[DIAG_CANAL + 2] > 0);
+    bool bitsAlAzar = true;
+    for (int b = 0; b < 8; ++b)
+        if (diag[DIAG_BIT + b] * 10 < bytes * 3 || diag[DIAG_BIT + b] * 10 > bytes * 7)
+            bitsAlAzar = false;
+    if (rotada * 10 >= bytes * 9)
+        cout << "  Probable rotacion equivocada: faltan " << mejorK
+             << " bits de rotacion a la izquierda antes del desenmascarado." << endl;
+    else if (canalesMal < 3)
+        cout << "  Solo difieren " << canalesMal << " canal(es): probable error por canal." << endl;
+    else if (nFilas > 0 && filasMal * 4 < nFilas)
+        cout << "  Diferencias concentradas en pocas filas: probable archivo corrupto." << endl;
+    else if (bitsAlAzar)
+        cout << "  Cada bit difiere en cerca de la mitad de los bytes: probable XOR con"
+             << " otro ruido o paso de XOR faltante." << endl;
+}
+
+// -----------------------------------------------------------------------------
+// Función ejecutarCadena: Recorre los pasos en orden aplicando cada operación a
+// toda la imagen; los pasos de desenmascarado reescriben su ventana.
+void ejecutarCadena(unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                    const int* cadena, int nPasos, int totalMaskBytes,
+                    unsigned char** S, const int* semillas,
+                    int* const* perms) {
+    unsigned char* tmp = nullptr;
+    for (int j = 0; j < nPasos; ++j) {
+        const int* paso = cadena + j * CAMPOS_PASO;
+        if (paso[0] == OP_DESENMASCARAR) {
+            desenmascarar(img, S[paso[1]], semillas[paso[1]], totalMaskBytes);
+        } else if (esPermutacion(paso[0])) {
+            if (!tmp)
+                tmp = reservarPixeles(dataSize);
+            permutarPixeles(img, tmp, perms[j], dataSize / 3);
+            memcpy(img, tmp, dataSize);
+        } else {
+            aplicarPaso(img, 0, dataSize, ruidos, dataSize, paso);
+        }
+    }
+    liberarPixeles(tmp);
+}
+
+// -----------------------------------------------------------------------------
+// Función canonizarTramosXor: Los XOR (con ruido, constante o PRNG) conmutan
+// entre sí, así que un tramo de XOR consecutivos se puede reordenar libremente.
+// Se ordena por tipo, parámetro e id; así los pasos iguales quedan juntos y se
+// cancelan de a pares (mismo ruido y desplazamiento, o misma semilla y
+// algoritmo), y todas las constantes se juntan en un solo XOR. Retorna la nueva
+// cantidad de pasos.
+static int canonizarTramosXor(int* cadena, int nPasos) {
+    int n = 0;
+    int j = 0;
+    while (j < nPasos) {
+        if (!esXor(cadena[j * CAMPOS_PASO])) {
+            for (int c = 0; c < CAMPOS_PASO; ++c)
+                cadena[n * CAMPOS_PASO + c] = cadena[j * CAMPOS_PASO + c];
+            ++n;
+            ++j;
+            continue;
+        }
+        int fin = j;
+        while (fin < nPasos && esXor(cadena[fin * CAMPOS_PASO]))
+            ++fin;
+        // Inserción por (tipo, parámetro, id): los tramos son de pocos pasos
+        for (int a = j + 1; a < fin; ++a) {
+            int paso[CAMPOS_PASO];
+            for (int c = 0; c < CAMPOS_PASO; ++c)
+                paso[c] = cadena[a * CAMPOS_PASO + c];
+            int b = a;
+            for (; b > j; --b) {
+                const int* previo = cadena + (b - 1) * CAMPOS_PASO;
+                bool mayor = previo[0] != paso[0] ? previo[0] > paso[0]
+                           : previo[1] != paso[1] ? previo[1] > paso[1] : previo[2] > paso[2];
+                if (!mayor)
+                    break;
+                for (int c = 0; c < CAMPOS_PASO; ++c)
+                    cadena[b * CAMPOS_PASO + c] = previo[c];
+            }
+            for (int c = 0; c < CAMPOS_PASO; ++c)
+                cadena[b * CAMPOS_PASO + c] = paso[c];
+        }
+        // El tramo ordenado se reduce copiándolo a partir de n (n <= j)
+        int inicioTramo = n;
+        int constante = 0;
+        for (int a = j; a < fin; ++a) {
+            int paso[CAMPOS_PASO];
+            for (int c = 0; c < CAMPOS_PASO; ++c)
+                paso[c] = cadena[a * CAMPOS_PASO + c];
+            if (paso[0] == OP_XOR_CONST) {
+                constante ^= paso[1];
+                continue;
+            }
+            if (constante != 0) {
+                // Las constantes ya terminaron: en el orden van antes que el PRNG
+                cadena[n * CAMPOS_PASO] = OP_XOR_CONST;
+                cadena[n * CAMPOS_PASO + 1] = constante;
+                cadena[n * CAMPOS_PASO + 2] = 0;
+                ++n;
+                constante = 0;
+            }
+            const int* ultimo = cadena + (n - 1) * CAMPOS_PASO;
+            if (n > inicioTramo && ultimo[0] == paso[0] && ultimo[1] == paso[1] &&
+                ultimo[2] == paso[2]) {
+                --n; // El mismo flujo dos veces se anula
+                continue;
+            }
+            for (int c = 0; c < CAMPOS_PASO; ++c)
+                cadena[n * CAMPOS_PASO + c] = paso[c];
+            ++n;
+        }
+        if (constante != 0) {
+            cadena[n * CAMPOS_PASO] = OP_XOR_CONST;
+            cadena[n * CAMPOS_PASO + 1] = constante;
+            cadena[n * CAMPOS_PASO + 2] = 0;
+            ++n;
+        }
+        j = fin;
+    }
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Función simplificarCadena: Lleva los pasos a forma canónica (rotación a la
+// derecha k = rotación a la izquierda 8 - k), quita los pasos nulos y repite
+// hasta que no haya más cambios:
+// 1. En cada tramo de XOR consecutivos, orden canónico, constantes juntas y
+//    cancelación de XOR repetidos (canonizarTramosXor), sin importar cuántos
+//    otros XOR haya entre ellos.
+// 2. Fusión de pasos adyacentes:
+//      rotIzq a, rotIzq b  -> rotIzq (a + b) mod 8
+//      desp a, desp b      -> desp (a + b) en la misma dirección (máximo 8)
+// Una cancelación puede dejar juntas dos rotaciones y una fusión que se anula
+// puede unir dos tramos de XOR; por eso se repite. No admite pasos de
+// desenmascarado ni permutaciones.
+int simplificarCadena(int* cadena, int nPasos) {
+    int n = nPasos;
+    int anterior = -1;
+    while (n != anterior) {
+        anterior = n;
+        n = canonizarTramosXor(cadena, n);
+        int m = 0;
+        for (int j = 0; j < n; ++j) {
+            int tipo = cadena[j * CAMPOS_PASO];
+            int k = cadena[j * CAMPOS_PASO + 1];
+            if (tipo == OP_ROT_DER) {
+                tipo = OP_ROT_IZQ;
+                k = 8 - (k & 7);
+            }
+            if (tipo == OP_ROT_IZQ)
+                k &= 7;
+            if ((tipo == OP_DESP_IZQ || tipo == OP_DESP_DER) && k > 8)
+                k = 8;
+            if (tipo == OP_XOR_CONST)
+                k &= 0xFF;
+            if (tipo != OP_XOR_RUIDO && tipo != OP_XOR_PRNG && k == 0)
+                continue; // Paso nulo
+            if (m > 0) {
+                int* ultimo = cadena + (m - 1) * CAMPOS_PASO;
+                if (tipo == OP_ROT_IZQ && ultimo[0] == OP_ROT_IZQ) {
+                    ultimo[1] = (ultimo[1] + k) & 7;
+                    if (ultimo[1] == 0)
+                        --m;
+                    continue;
+                }
+                if ((tipo == OP_DESP_IZQ || tipo == OP_DESP_DER) && ultimo[0] == tipo) {
+                    ultimo[1] = ultimo[1] + k > 8 ? 8 : ultimo[1] + k;
+                    continue;
+                }
+            }
+            int id = cadena[j * CAMPOS_PASO + 2];
+            int* destino = cadena + m * CAMPOS_PASO;
+            destino[0] = tipo;
+            destino[1] = k;
+            destino[2] = (tipo == OP_XOR_RUIDO || tipo == OP_XOR_PRNG) ? id : 0;
+            ++m;
+        }
+        n = m;
+    }
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Función verificarSimplificacion: Cada cadena de la tabla se aplica a 4 KiB
+// sintéticos tal cual y ya simplificada, con dos ruidos distintos, y los
+// resultados deben ser iguales.
+int verificarSimplificacion() {
+    const int MAX_PRUEBA = 8;
+    const int PRUEBAS[][MAX_PRUEBA * CAMPOS_PASO] = {
+        // XOR ruido y XOR PRNG repetidos con otros XOR en medio
+        { OP_XOR_RUIDO, 0, 0, OP_XOR_CONST, 5, 0, OP_XOR_RUIDO, 0, 0, OP_ROT_IZQ, 3, 0,
+          OP_XOR_PRNG, 7, PRNG_SPLITMIX64, OP_ROT_IZQ, 5, 0 },
+        // La cancelación deja juntas dos rotaciones que se anulan y une dos tramos
+        { OP_XOR_RUIDO, 2, 1, OP_ROT_IZQ, 3, 0, OP_XOR_PRNG, 9, PRNG_SPLITMIX64,
+          OP_XOR_CONST, 17, 0, OP_XOR_PRNG, 9, PRNG_SPLITMIX64, OP_XOR_CONST, 17, 0,
+          OP_ROT_DER, 3, 0, OP_XOR_RUIDO, 2, 1 },
+        // Mismo ruido con distinto desplazamiento o distinto id: no se cancela
+        { OP_XOR_RUIDO, 0, 0, OP_XOR_RUIDO, 1, 0, OP_XOR_CONST, 3, 0, OP_XOR_RUIDO, 0, 1,
+          OP_XOR_CONST, 3, 0 },
+        // Desplazamientos que se acumulan y rotaciones que no se anulan
+        { OP_DESP_IZQ, 2, 0, OP_DESP_IZQ, 3, 0, OP_ROT_DER, 1, 0, OP_ROT_IZQ, 4, 0,
+          OP_XOR_CONST, 0, 0 }
+    };
+    const int PASOS[] = { 6, 8, 5, 5 };
+    const int ESPERADOS[] = { 4, 0, 3, 2 };
+    const int N_PRUEBAS = 4;
+    const int TAM = 4096;
+    unsigned char* datos = new unsigned char[TAM];
+    unsigned char* copia = new unsigned char[TAM];
+    unsigned char* ruido0 = new unsigned char[TAM];
+    unsigned char* ruido1 = new unsigned char[TAM];
+    for (int i = 0; i < TAM; ++i) {
+        datos[i] = static_cast<unsigned char>(palabraPrng(1, i));
+        ruido0[i] = static_cast<unsigned char>(palabraPrng(2, i));
+        ruido1[i] = static_cast<unsigned char>(palabraPrng(3, i));
+    }
+    const unsigned char* ruidos[2] = { ruido0, ruido1 };
+    int fallidas = 0;
+    for (int t = 0; t < N_PRUEBAS; ++t) {
+        int cadena[MAX_PRUEBA * CAMPOS_PASO];
+        for (int c = 0; c < PASOS[t] * CAMPOS_PASO; ++c)
+            cadena[c] = PRUEBAS[t][c];
+        int n = simplificarCadena(cadena, PASOS[t]);
+        memcpy(copia, datos, TAM);
+        for (int j = 0; j < PASOS[t]; ++j)
+            aplicarPaso(datos, 0, TAM, ruidos, TAM, PRUEBAS[t] + j * CAMPOS_PASO);
+        for (int j = 0; j < n; ++j)
+            aplicarPaso(copia, 0, TAM, ruidos, TAM, cadena + j * CAMPOS_PASO);
+        bool bien = n == ESPERADOS[t] && memcmp(datos, copia, TAM) == 0;
+        cout << "Prueba " << t + 1 << ": " << PASOS[t] << " -> " << n << " pasos (se esperaban "
+             << ESPERADOS[t] << "), " << (bien ? "bien" : "FALLA") << endl;
+        if (!bien)
+            ++fallidas;
+    }
+    delete [] datos;
+    delete [] copia;
+    delete [] ruido0;
+    delete [] ruido1;
+    return fallidas;
+}
+
+// -----------------------------------------------------------------------------
+// Función ejecutarTramoLocal: Un desenmascarado solo es barrera dentro de
+// su ventana. Fuera de todas las ventanas el resultado es la cadena sin pasos de
+// desenmascarado, que se simplifica antes de recorrer la imagen (por ejemplo
+// XOR, desenmascarar, XOR queda sin ninguna pasada completa). Los bytes de las
+// ventanas se calculan aparte con evaluación dispersa sobre la imagen original
+// y se escriben al final. El tramo no debe contener permutaciones.
+#ifdef DESAFIO_X86
+// Núcleos vectoriales para XOR y rotación. La rotación de bytes se arma con
+// desplazamientos de 16 bits y máscaras que descartan los bits que pasan de
+// un byte al vecino. SSE2 es parte de x86-64; AVX2 y AVX-512 se compilan con
+// el atributo target y solo se llaman si varianteDisponible lo confirma.
+static void xorSse2(unsigned char* d, const unsigned char* r, int len) {
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm_xor_si128(a, b));
+    }
+    for (; i < len; ++i)
+        d[i] ^= r[i];
+}
+
+static void rotarSse2(unsigned char* d, int len, int k) {
+    __m128i alto = _mm_set1_epi8(static_cast<char>((0xFF << k) & 0xFF));
+    __m128i bajo = _mm_set1_epi8(static_cast<char>(0xFF >> (8 - k)));
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        __m128i izq = _mm_and_si128(_mm_slli_epi16(v, k), alto);
+        __m128i der = _mm_and_si128(_mm_srli_epi16(v, 8 - k), bajo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm_or_si128(izq, der));
+    }
+    for (; i < len; ++i)
+        d[i] = brotate_left(d[i], k);
+}
+
+__attribute__((target("avx2")))
+static void xorAvx2(unsigned char* d, const unsigned char* r, int len) {
+    int i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), _mm256_xor_si256(a, b));
+    }
+    for (; i < len; ++i)
+        d[i] ^= r[i];
+}
+
+__attribute__((target("avx2")))
+static void rotarAvx2(unsigned char* d, int len, int k) {
+    __m256i alto = _mm256_set1_epi8(static_cast<char>((0xFF << k) & 0xFF));
+    __m256i bajo = _mm256_set1_epi8(static_cast<char>(0xFF >> (8 - k)));
+    int i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        __m256i izq = _mm256_and_si256(_mm256_slli_epi16(v, k), alto);
+        __m256i der = _mm256_and_si256(_mm256_srli_epi16(v, 8 - k), bajo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), _mm256_or_si256(izq, der));
+    }
+    for (; i < len; ++i)
+        d[i] = brotate_left(d[i], k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void xorAvx512(unsigned char* d, const unsigned char* r, int len) {
+    int i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i a = _mm512_loadu_si512(d + i);
+        __m512i b = _mm512_loadu_si512(r + i);
+        _mm512_storeu_si512(d + i, _mm512_xor_si512(a, b));
+    }
+    for (; i < len; ++i)
+        d[i] ^= r[i];
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void rotarAvx512(unsigned char* d, int len, int k) {
+    __m512i alto = _mm512_set1_epi8(static_cast<char>((0xFF << k) & 0xFF));
+    __m512i bajo = _mm512_set1_epi8(static_cast<char>(0xFF >> (8 - k)));
+    int i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i v = _mm512_loadu_si512(d + i);
+        __m512i izq = _mm512_and_si512(_mm512_slli_epi16(v, k), alto);
+        __m512i der = _mm512_and_si512(_mm512_srli_epi16(v, 8 - k), bajo);
+        _mm512_storeu_si512(d + i, _mm512_or_si512(izq, der));
+    }
+    for (; i < len; ++i)
+        d[i] = brotate_left(d[i], k);
+}
+
+static void xorNucleo(int variante, unsigned char* d, const unsigned char* r, int len) {
+    if (variante == VAR_AVX512)
+        xorAvx512(d, r, len);
+    else if (variante == VAR_AVX2)
+        xorAvx2(d, r, len);
+    else
+        xorSse2(d, r, len);
+}
+
+static void rotarNucleo(int variante, unsigned char* d, int len, int k) {
+    if (variante == VAR_AVX512)
+        rotarAvx512(d, len, k);
+    else if (variante == VAR_AVX2)
+        rotarAvx2(d, len, k);
+    else
+        rotarSse2(d, len, k);
+}
+
+// XOR con el flujo de palabraPrng calculando varias palabras a la vez, una por
+// carril de 64 bits (4 en AVX2, 8 en AVX-512). Ninguno de los dos tiene
+// producto de 64 bits (AVX-512 lo tiene solo con DQ), así que se arma con tres
+// productos de 32x32 bits: a * b = aL * bL + ((aH * bL + aL * bH) << 32). Con
+// los 2 carriles de SSE2 eso no le gana al producto escalar de 64 bits, así
+// que SSE2 sigue con el recorrido palabra a palabra de aplicarPaso. "d" debe
+// empezar en la palabra "contador" del flujo. Procesan solo bloques completos
+// del ancho del vector y retornan cuántos bytes hicieron.
+static const unsigned long long PRNG_DORADO = 0x9E3779B97F4A7C15ULL;
+static const unsigned long long PRNG_MEZCLA1 = 0xBF58476D1CE4E5B9ULL;
+static const unsigned long long PRNG_MEZCLA2 = 0x94D049BB133111EBULL;
+
+__attribute__((target("avx2")))
+static inline __m256i mul64Avx2(__m256i a, unsigned long long b) {
+    __m256i bajo = _mm256_set1_epi64x(static_cast<long long>(b & 0xFFFFFFFFULL));
+    __m256i alto = _mm256_set1_epi64x(static_cast<long long>(b >> 32));
+    __m256i cruzados = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), bajo),
+                                        _mm256_mul_epu32(a, alto));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, bajo), _mm256_slli_epi64(cruzados, 32));
+}
+
+__attribute__((target("avx2")))
+static int xorPrngAvx2(unsigned char* d, int len, unsigned long long semilla,
+                       unsigned long long contador) {
+    long long z[4];
+    for (int c = 0; c < 4; ++c)
+        z[c] = static_cast<long long>(semilla + (contador + 1 + c) * PRNG_DORADO);
+    __m256i z0 = _mm256_set_epi64x(z[3], z[2], z[1], z[0]);
+    __m256i avance = _mm256_set1_epi64x(static_cast<long long>(4 * PRNG_DORADO));
+    int i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i w = _mm256_xor_si256(z0, _mm256_srli_epi64(z0, 30));
+        w = mul64Avx2(w, PRNG_MEZCLA1);
+        w = mul64Avx2(_mm256_xor_si256(w, _mm256_srli_epi64(w, 27)), PRNG_MEZCLA2);
+        w = _mm256_xor_si256(w, _mm256_srli_epi64(w, 31));
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), _mm256_xor_si256(v, w));
+        z0 = _mm256_add_epi64(z0, avance);
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i mul64Avx512(__m512i a, unsigned long long b) {
+    __m512i bajo = _mm512_set1_epi64(static_cast<long long>(b & 0xFFFFFFFFULL));
+    __m512i alto = _mm512_set1_epi64(static_cast<long long>(b >> 32));
+    __m512i cruzados = _mm512_add_epi64(_mm512_mul_epu32(_mm512_srli_epi64(a, 32), bajo),
+                                        _mm512_mul_epu32(a, alto));
+    return _mm512_add_epi64(_mm512_mul_epu32(a, bajo), _mm512_slli_epi64(cruzados, 32));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int xorPrngAvx512(unsigned char* d, int len, unsigned long long semilla,
+                         unsigned long long contador) {
+    long long z[8];
+    for (int c = 0; c < 8; ++c)
+        z[c] = static_cast<long long>(semilla + (contador + 1 + c) * PRNG_DORADO);
+    __m512i z0 = _mm512_set_epi64(z[7], z[6], z[5], z[4], z[3], z[2], z[1], z[0]);
+    __m512i avance = _mm512_set1_epi64(static_cast<long long>(8 * PRNG_DORADO));
+    int i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i w = _mm512_xor_si512(z0, _mm512_srli_epi64(z0, 30));
+        w = mul64Avx512(w, PRNG_MEZCLA1);
+        w = mul64Avx512(_mm512_xor_si512(w, _mm512_srli_epi64(w, 27)), PRNG_MEZCLA2);
+        w = _mm512_xor_si512(w, _mm512_srli_epi64(w, 31));
+        __m512i v = _mm512_loadu_si512(d + i);
+        _mm512_storeu_si512(d + i, _mm512_xor_si512(v, w));
+        z0 = _mm512_add_epi64(z0, avance);
+    }
+    return i;
+}
+
+static int xorPrngNucleo(int variante, unsigned char* d, int len, unsigned long long semilla,
+                         unsigned long long contador) {
+    if (variante == VAR_AVX512)
+        return xorPrngAvx512(d, len, semilla, contador);
+    if (variante == VAR_AVX2)
+        return xorPrngAvx2(d, len, semilla, contador);
+    return 0;
+}
+#endif
+
+bool varianteDisponible(int variante) {
+    if (variante == VAR_ESCALAR)
+        return true;
+#ifdef DESAFIO_X86
+    if (variante == VAR_SSE2)
+        return true;
+    if (variante == VAR_AVX2)
+        return __builtin_cpu_supports("avx2");
+    if (variante == VAR_AVX512)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    return false;
+}
+
+// Tablas de ROT_TABLA para los pasos del plan: 256 entradas por paso, armadas
+// una sola vez antes del recorrido. Retorna nullptr si el perfil no las usa.
+static unsigned char* armarTablasRotacion(const int* plan, int nPlan, const int* perfil) {
+    if (perfil[AJ_VARIANTE] != VAR_ESCALAR || perfil[AJ_ROTACION] != ROT_TABLA || nPlan <= 0)
+        return nullptr;
+    unsigned char* tablas = new unsigned char[nPlan * 256];
+    for (int j = 0; j < nPlan; ++j) {
+        const int* paso = plan + j * CAMPOS_PASO;
+        if (paso[0] != OP_ROT_IZQ && paso[0] != OP_ROT_DER)
+            continue;
+        int giro = (paso[0] == OP_ROT_IZQ ? paso[1] : 8 - paso[1]) & 7;
+        for (int v = 0; v < 256; ++v)
+            tablas[j * 256 + v] = brotate_left(static_cast<unsigned char>(v), giro);
+    }
+    return tablas;
+}
+
+// Igual que aplicarPaso pero con el núcleo del perfil para los XOR con ruido o
+// con el PRNG y las rotaciones. Los demás pasos van siempre por aplicarPaso.
+// "tabla" es la del paso armada por armarTablasRotacion (nullptr sin ROT_TABLA).
+static void aplicarPasoAjustado(unsigned char* datos, int base, int len,
+                                const unsigned char* const* ruidos, int tamRuido,
+                                const int* paso, const int* perfil,
+                                const unsigned char* tabla) {
+    int tipo = paso[0];
+    bool rotacion = tipo == OP_ROT_IZQ || tipo == OP_ROT_DER;
+    int giro = (tipo == OP_ROT_IZQ ? paso[1] : 8 - paso[1]) & 7;
+    if (perfil[AJ_VARIANTE] == VAR_ESCALAR) {
+        if (rotacion && tabla) {
+            for (int i = 0; i < len; ++i)
+                datos[i] = tabla[datos[i]];
+            return;
+        }
+        aplicarPaso(datos, base, len, ruidos, tamRuido, paso);
+        return;
+    }
+#ifdef DESAFIO_X86
+    int variante = perfil[AJ_VARIANTE];
+    if (tipo == OP_XOR_RUIDO) {
+        // Mismos tramos contiguos del ruido desplazado que en aplicarPaso
+        int pos = static_cast<int>(((static_cast<long long>(base) + paso[1]) % tamRuido
+                                    + tamRuido) % tamRuido);
+        int i = 0;
+        while (i < len) {
+            int tramo = tamRuido - pos < len - i ? tamRuido - pos : len - i;
+            xorNucleo(variante, datos + i, ruidos[paso[2]] + pos, tramo);
+            i += tramo;
+            pos = 0;
+        }
+        return;
+    }
+    if (rotacion) {
+        if (giro != 0)
+            rotarNucleo(variante, datos, len, giro);
+        return;
+    }
+    if (tipo == OP_XOR_PRNG && paso[2] == PRNG_SPLITMIX64) {
+        // Hasta la primera palabra completa y el resto que no llena un vector
+        // van por aplicarPaso
+        int cabeza = (8 - base % 8) % 8;
+        if (cabeza > len)
+            cabeza = len;
+        aplicarPaso(datos, base, cabeza, ruidos, tamRuido, paso);
+        int hecho = cabeza;
+        hecho += xorPrngNucleo(variante, datos + hecho, len - hecho,
+                               static_cast<unsigned int>(paso[1]),
+                               (static_cast<unsigned long long>(base) + hecho) / 8);
+        aplicarPaso(datos + hecho, base + hecho, len - hecho, ruidos, tamRuido, paso);
+        return;
+    }
+#endif
+    aplicarPaso(datos, base, len, ruidos, tamRuido, paso);
+}
+
+// Pide a la caché las líneas de img[ini..ini+len) y de los ruidos que leen
+// los XOR del plan en esas posiciones.
+static inline void prefetchRango(const unsigned char* img, const unsigned char* const* ruidos,
+                                 const int* plan, int nPlan, int ini, int len, int dataSize) {
+    if (ini >= dataSize)
+        return;
+    int fin = ini + len < dataSize ? ini + len : dataSize;
+    for (int i = ini; i < fin; i += 64)
+        __builtin_prefetch(img + i, 1);
+    for (int j = 0; j < nPlan; ++j) {
+        const int* paso = plan + j * CAMPOS_PASO;
+        if (paso[0] != OP_XOR_RUIDO)
+            continue;
+        int pos = static_cast<int>(((static_cast<long long>(ini) + paso[1]) % dataSize
+                                    + dataSize) % dataSize);
+        for (int i = ini; i < fin; i += 64) {
+            __builtin_prefetch(ruidos[paso[2]] + pos);
+            pos += 64;
+            if (pos >= dataSize)
+                pos -= dataSize;
+        }
+    }
+}
+
+// Aplica el plan a los bloques [primero, ultimo) de la imagen. Todos los pasos
+// se aplican a un bloque antes de pasar al siguiente, así solo el primero lo
+// trae de memoria. Ese primer paso avanza por tramos de 4 KiB pidiendo con
+// prefetch los datos "adelanto" bytes más adelante.
+static void recorrerBloques(unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                            const int* plan, int nPlan, const int* perfil,
+                            const unsigned char* tablas, int bloque, int primero, int ultimo) {
+    const int TRAMO = 4096;
+    int adelanto = perfil[AJ_PREFETCH];
+    for (int b = primero; b < ultimo; ++b) {
+        int base = b * bloque;
+        int len = bloque < dataSize - base ? bloque : dataSize - base;
+        for (int t = 0; t < len; t += TRAMO) {
+            int lt = TRAMO < len - t ? TRAMO : len - t;
+            if (adelanto > 0)
+                prefetchRango(img, ruidos, plan, nPlan, base + t + adelanto, lt, dataSize);
+            aplicarPasoAjustado(img + base + t, base + t, lt, ruidos, dataSize, plan, perfil,
+                                tablas);
+        }
+        for (int j = 1; j < nPlan; ++j)
+            aplicarPasoAjustado(img + base, base, len, ruidos, dataSize, plan + j * CAMPOS_PASO,
+                                perfil, tablas ? tablas + j * 256 : nullptr);
+    }
+}
+
+static int ejecutarTramoLocal(unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                              const int* cadena, int nPasos, int totalMaskBytes,
+                              unsigned char** S, const int* semillas,
+                              const int* perfil) {
+    // Parte de ventanas: rangos de cada desenmascarado, ordenados y fusionados
+    int* rangos = new int[2 * nPasos + 2];
+    int nRangos = 0;
+    for (int j = 0; j < nPasos; ++j) {
+        const int* paso = cadena + j * CAMPOS_PASO;
+        if (paso[0] != OP_DESENMASCARAR || totalMaskBytes <= 0)
+            continue;
+        int ini = semillas[paso[1]];
+        int fin = ini + totalMaskBytes;
+        int pos = nRangos;
+        while (pos > 0 && rangos[2 * (pos - 1)] > ini) {
+            rangos[2 * pos] = rangos[2 * (pos - 1)];
+            rangos[2 * pos + 1] = rangos[2 * (pos - 1) + 1];
+            --pos;
+        }
+        rangos[2 * pos] = ini;
+        rangos[2 * pos + 1] = fin;
+        ++nRangos;
+    }
+    int fusionados = 0;
+    int totalVentanas = 0;
+    for (int r = 0; r < nRangos; ++r) {
+        if (fusionados > 0 && rangos[2 * r] <= rangos[2 * (fusionados - 1) + 1]) {
+            if (rangos[2 * r + 1] > rangos[2 * (fusionados - 1) + 1])
+                rangos[2 * (fusionados - 1) + 1] = rangos[2 * r + 1];
+            continue;
+        }
+        rangos[2 * fusionados] = rangos[2 * r];
+        rangos[2 * fusionados + 1] = rangos[2 * r + 1];
+        ++fusionados;
+    }
+    for (int r = 0; r < fusionados; ++r)
+        totalVentanas += rangos[2 * r + 1] - rangos[2 * r];
+    unsigned char* ventanas = new unsigned char[totalVentanas > 0 ? totalVentanas : 1];
+    evaluarRangos(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes, S,
+                  semillas, nullptr, rangos, fusionados, ventanas);
+
+    // Parte de imagen completa: cadena sin desenmascarados, simplificada
+    int* plan = new int[(nPasos > 0 ? nPasos : 1) * CAMPOS_PASO];
+    int nPlan = 0;
+    for (int j = 0; j < nPasos; ++j) {
+        if (cadena[j * CAMPOS_PASO] == OP_DESENMASCARAR)
+            continue;
+        for (int c = 0; c < CAMPOS_PASO; ++c)
+            plan[nPlan * CAMPOS_PASO + c] = cadena[j * CAMPOS_PASO + c];
+        ++nPlan;
+    }
+    nPlan = simplificarCadena(plan, nPlan);
+    unsigned char* tablas = armarTablasRotacion(plan, nPlan, perfil);
+    // Recorrido por bloques del tamaño de L2, repartidos en tramos contiguos
+    // entre los hilos del perfil
+    int bloque = perfil[AJ_BLOQUE];
+    if (bloque <= 0 || bloque > dataSize)
+        bloque = dataSize;
+    int nBloques = dataSize > 0 ? (dataSize + bloque - 1) / bloque : 0;
+    int nHilos = perfil[AJ_HILOS] < nBloques ? perfil[AJ_HILOS] : nBloques;
+    if (nPlan > 0 && nHilos > 1) {
+        QThread** hilos = new QThread*[nHilos];
+        for (int t = 0; t < nHilos; ++t) {
+            int primero = static_cast<int>(static_cast<long long>(nBloques) * t / nHilos);
+            int ultimo = static_cast<int>(static_cast<long long>(nBloques) * (t + 1) / nHilos);
+            hilos[t] = QThread::create([=]() {
+                recorrerBloques(img, dataSize, ruidos, plan, nPlan, perfil, tablas, bloque,
+                                primero, ultimo);
+            });
+            hilos[t]->start();
+        }
+        for (int t = 0; t < nHilos; ++t) {
+            hilos[t]->wait();
+            delete hilos[t];
+        }
+        delete [] hilos;
+    } else if (nPlan > 0) {
+        recorrerBloques(img, dataSize, ruidos, plan, nPlan, perfil, tablas, bloque, 0,
+                        nBloques);
+    }
+
+    // Se reescriben las ventanas (recortadas igual que en evaluarRangos)
+    int k = 0;
+    for (int r = 0; r < fusionados; ++r) {
+        int ini = rangos[2 * r] < 0 ? 0 : rangos[2 * r];
+        int fin = rangos[2 * r + 1] > dataSize ? dataSize : rangos[2 * r + 1];
+        for (int i = ini; i < fin; ++i)
+            img[i] = ventanas[k++];
+    }
+
+    delete [] tablas;
+    delete [] plan;
+    delete [] ventanas;
+    delete [] rangos;
+    return nPlan;
+}
+
+// -----------------------------------------------------------------------------
+// Función ejecutarCadenaOptimizada: Divide la cadena en tramos locales al byte
+// separados por permutaciones. Cada tramo se ejecuta con ejecutarTramoLocal y
+// cada permutación con un "gather" hacia un buffer auxiliar, que se
+// alterna con la imagen para no copiar después de cada permutación.
+int ejecutarCadenaOptimizada(unsigned char* img, int dataSize, const unsigned char* const* ruidos,
+                             const int* cadena, int nPasos, int totalMaskBytes,
+                             unsigned char** S, const int* semillas,
+                             int* const* perms, const int* perfil) {
+    int porDefecto[AJ_TOTAL];
+    if (!perfil) {
+        perfilPorDefecto(porDefecto);
+        perfil = porDefecto;
+    }
+    unsigned char* actual = img;
+    unsigned char* tmp = nullptr;
+    int pasadas = 0;
+    int ini = 0;
+    while (ini < nPasos) {
+        int fin = ini;
+        while (fin < nPasos && !esPermutacion(cadena[fin * CAMPOS_PASO]))
+            ++fin;
+        pasadas += ejecutarTramoLocal(actual, dataSize, ruidos, cadena + ini * CAMPOS_PASO,
+                                      fin - ini, totalMaskBytes, S, semillas, perfil);
+        if (fin < nPasos) {
+            if (!tmp)
+                tmp = reservarPixeles(dataSize);
+            unsigned char* destino = (actual == img) ? tmp : img;
+            permutarPixeles(actual, destino, perms[fin], dataSize / 3);
+            actual = destino;
+            ++pasadas;
+        }
+        ini = fin + 1;
+    }
+    if (actual != img)
+        memcpy(img, actual, dataSize);
+    liberarPixeles(tmp);
+    return pasadas;
+}
+
+// -----------------------------------------------------------------------------
+// Función perfilPorDefecto: Bloques de 256 KiB (cabe en la L2 de un núcleo en
+// casi cualquier procesador), prefetch de dos tramos, un hilo y el núcleo
+// escalar.
+void perfilPorDefecto(int* perfil) {
+    perfil[AJ_BLOQUE] = 256 << 10;
+    perfil[AJ_PREFETCH] = 8192;
+    perfil[AJ_HILOS] = 1;
+    perfil[AJ_VARIANTE] = VAR_ESCALAR;
+    perfil[AJ_ROTACION] = ROT_DESPLAZAMIENTO;
+}
+
+// Datos sintéticos para las mediciones del perfil: imagen y ruido de "megas" MiB
+static int prepararMedicion(int megas, unsigned char* &datos, unsigned char* &ruido) {
+    if (megas < 1)
+        megas = 1;
+    if (megas > 512)
+        megas = 512;
+    int dataSize = (megas << 20) / 3 * 3;
+    datos = reservarPixeles(dataSize);
+    ruido = reservarPixeles(dataSize);
+    for (int i = 0; i < dataSize; ++i) {
+        datos[i] = static_cast<unsigned char>(palabraPrng(1, i));
+        ruido[i] = static_cast<unsigned char>(palabraPrng(2, i));
+    }
+    return dataSize;
+}
+
+// Ejecuta una cadena de imagen completa de tres pasos (XOR, rotación y XOR
+// desplazado, que no se simplifican entre sí) con el perfil dado y retorna el
+// menor de dos tiempos en nanosegundos.
+static long long medirPerfil(unsigned char* datos, const unsigned char* ruido, int dataSize,
+                             const int* perfil) {
+    const unsigned char* ruidos[1] = { ruido };
+    const int cadena[] = { OP_XOR_RUIDO, 0, 0, OP_ROT_IZQ, 3, 0, OP_XOR_RUIDO, 3, 0 };
+    long long ns = -1;
+    for (int r = 0; r < 2; ++r) {
+        QElapsedTimer reloj;
+        reloj.start();
+        ejecutarTramoLocal(datos, dataSize, ruidos, cadena, 3, 0, nullptr, nullptr,
+                           perfil);
+        long long t = reloj.nsecsElapsed();
+        if (ns < 0 || t < ns)
+            ns = t;
+    }
+    return ns;
+}
+
+// Barrido de bloque y prefetch manteniendo los demás campos del perfil
+static void barrerBloques(unsigned char* datos, const unsigned char* ruido, int dataSize,
+                          int* perfil, bool mostrar) {
+    const int bloques[] = { 32 << 10, 64 << 10, 128 << 10, 256 << 10, 512 << 10,
+                            1 << 20, 2 << 20, 0 };
+    const int adelantos[] = { 0, 4096, 8192, 16384 };
+    int prueba[AJ_TOTAL];
+    for (int c = 0; c < AJ_TOTAL; ++c)
+        prueba[c] = perfil[c];
+    long long mejor = -1;
+    for (int b = 0; b < 8; ++b) {
+        for (int a = 0; a < 4; ++a) {
+            prueba[AJ_BLOQUE] = bloques[b];
+            prueba[AJ_PREFETCH] = adelantos[a];
+            long long ns = medirPerfil(datos, ruido, dataSize, prueba);
+            if (mostrar)
+                cout << "  Bloque " << (bloques[b] ? bloques[b] >> 10 : 0) << " KiB"
+                     << (bloques[b] ? "" : " (sin bloques)") << ", prefetch " << adelantos[a]
+                     << ": " << ns / 1000000.0 << " ms" << endl;
+            if (mejor < 0 || ns < mejor) {
+                mejor = ns;
+                perfil[AJ_BLOQUE] = bloques[b];
+                perfil[AJ_PREFETCH] = adelantos[a];
+            }
+        }
+    }
+    if (mostrar)
+        cout << "Elegido: bloque " << (perfil[AJ_BLOQUE] >> 10) << " KiB, prefetch "
+             << perfil[AJ_PREFETCH] << endl;
+}
+
+// -----------------------------------------------------------------------------
+// Función calibrarPerfil: Calibración rápida de bloque y prefetch.
+void calibrarPerfil(int* perfil, int megas, bool mostrar) {
+    unsigned char* datos = nullptr;
+    unsigned char* ruido = nullptr;
+    int dataSize = prepararMedicion(megas, datos, ruido);
+    barrerBloques(datos, ruido, dataSize, perfil, mostrar);
+    liberarPixeles(datos);
+    liberarPixeles(ruido);
+}
+
+// -----------------------------------------------------------------------------
+// Función autoajustar: Ajuste por coordenadas: primero el núcleo (con bloque y
+// prefetch por defecto y un hilo), luego bloque y prefetch con ese núcleo y
+// al final la cantidad de hilos (potencias de 2 y la cantidad ideal de Qt).
+void autoajustar(int* perfil, int megas) {
+    unsigned char* datos = nullptr;
+    unsigned char* ruido = nullptr;
+    int dataSize = prepararMedicion(megas, datos, ruido);
+    const char* nombres[] = { "escalar", "SSE2", "AVX2", "AVX-512" };
+    cout << "Nucleos (" << ((dataSize + (1 << 19)) >> 20) << " MiB):" << endl;
+    int prueba[AJ_TOTAL];
+    for (int c = 0; c < AJ_TOTAL; ++c)
+        prueba[c] = perfil[c];
+    prueba[AJ_HILOS] = 1;
+    long long mejor = -1;
+    for (int v = VAR_ESCALAR; v <= VAR_AVX512; ++v) {
+        if (!varianteDisponible(v))
+            continue;
+        for (int r = ROT_DESPLAZAMIENTO; r <= ROT_TABLA; ++r) {
+            if (v != VAR_ESCALAR && r == ROT_TABLA)
+                continue; // La tabla solo existe en el núcleo escalar
+            prueba[AJ_VARIANTE] = v;
+            prueba[AJ_ROTACION] = r;
+            long long ns = medirPerfil(datos, ruido, dataSize, prueba);
+            cout << "  " << nombres[v] << (r == ROT_TABLA ? " (rotacion por tabla)" : "")
+                 << ": " << ns / 1000000.0 << " ms" << endl;
+            if (mejor < 0 || ns < mejor) {
+                mejor = ns;
+                perfil[AJ_VARIANTE] = v;
+                perfil[AJ_ROTACION] = r;
+            }
+        }
+    }
+    perfil[AJ_HILOS] = 1;
+    cout << "Bloque y prefetch con " << nombres[perfil[AJ_VARIANTE]] << ":" << endl;
+    barrerBloques(datos, ruido, dataSize, perfil, true);
+
+    cout << "Hilos:" << endl;
+    int ideal = QThread::idealThreadCount();
+    for (int c = 0; c < AJ_TOTAL; ++c)
+        prueba[c] = perfil[c];
+    mejor = -1;
+    int n = 1;
+    while (true) {
+        prueba[AJ_HILOS] = n;
+        long long ns = medirPerfil(datos, ruido, dataSize, prueba);
+        cout << "  " << n << ": " << ns / 1000000.0 << " ms" << endl;
+        if (mejor < 0 || ns < mejor) {
+            mejor = ns;
+            perfil[AJ_HILOS] = n;
+        }
+        if (n >= ideal)
+            break;
+        n = n * 2 < ideal ? n * 2 : ideal;
+    }
+    liberarPixeles(datos);
+    liberarPixeles(ruido);
+}
+
+static const char* const NOMBRES_AJUSTE[AJ_TOTAL] = {
+    "bloque", "prefetch", "hilos", "variante", "rotacion"
+};
+
+// -----------------------------------------------------------------------------
+// Función cargarPerfil: Lee las líneas "nombre valor" (las que empiezan con
+// '#' son comentarios). Retorna false si el archivo no existe.
+bool cargarPerfil(const char* ruta, int* perfil) {
+    ifstream f(ruta);
+    if (!f)
+        return false;
+    string nombre;
+    while (f >> nombre) {
+        if (nombre[0] == '#') {
+            getline(f, nombre);
+            continue;
+        }
+        int valor = 0;
+        if (!(f >> valor))
+            break;
+        for (int c = 0; c < AJ_TOTAL; ++c)
+            if (nombre == NOMBRES_AJUSTE[c])
+                perfil[c] = valor;
+    }
+    // Un perfil copiado de otra máquina puede pedir un núcleo que esta no tiene
+    if (!varianteDisponible(perfil[AJ_VARIANTE]))
+        perfil[AJ_VARIANTE] = VAR_ESCALAR;
+    if (perfil[AJ_HILOS] < 1)
+        perfil[AJ_HILOS] = 1;
+    return true;
+}
+
+bool guardarPerfil(const char* ruta, const int* perfil) {
+    ofstream f(ruta);
+    if (!f)
+        return false;
+    f << "# Perfil de ajuste (--autotune lo vuelve a medir por completo)\n";
+    for (int c = 0; c < AJ_TOTAL; ++c)
+        f << NOMBRES_AJUSTE[c] << " " << perfil[c] << "\n";
+    return static_cast<bool>(f);
+}
+
+// -----------------------------------------------------------------------------
+// Función generarPermutacion: Fisher-Yates partiendo de la identidad, con un
+// generador xorshift32 inicializado con la semilla (0 se reemplaza por 1).
+void generarPermutacion(int* tabla, int n, unsigned int semilla) {
+    unsigned int x = semilla ? semilla : 1u;
+    for (int i = 0; i < n; ++i)
+        tabla[i] = i;
+    for (int i = n - 1; i > 0; --i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int j = static_cast<int>(x % static_cast<unsigned int>(i + 1));
+        int t = tabla[i];
+        tabla[i] = tabla[j];
+        tabla[j] = t;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Función invertirPermutacion: inversa[tabla[p]] = p, de modo que aplicar
+// "tabla" y luego "inversa" deja cada píxel en su posición original.
+void invertirPermutacion(const int* tabla, int* inversa, int n) {
+    for (int p = 0; p < n; ++p)
+        inversa[tabla[p]] = p;
+}
+
+// -----------------------------------------------------------------------------
+// Función prepararPermutaciones: Una tabla de origen por paso de permutación,
+// de modo que el píxel de salida p toma el valor del píxel de entrada tabla[p].
+int** prepararPermutaciones(const int* cadena, int nPasos, int ancho, int alto) {
+    int** perms = new int*[nPasos > 0 ? nPasos : 1];
+    int n = ancho * alto;
+    for (int j = 0; j < nPasos; ++j) {
+        int tipo = cadena[j * CAMPOS_PASO];
+        int k = cadena[j * CAMPOS_PASO + 1];
+        perms[j] = nullptr;
+        if (!esPermutacion(tipo) || n <= 0)
+            continue;
+        int* tabla = new int[n];
+        if (tipo == OP_ROT_FILAS) {
+            int d = ((k % alto) + alto) % alto;
+            for (int y = 0; y < alto; ++y) {
+                int origen = (y - d + alto) % alto;
+                for (int x = 0; x < ancho; ++x)
+                    tabla[y * ancho + x] = origen * ancho + x;
+            }
+        } else if (tipo == OP_ROT_COLUMNAS) {
+            int d = ((k % ancho) + ancho) % ancho;
+            for (int y = 0; y < alto; ++y)
+                for (int x = 0; x < ancho; ++x)
+                    tabla[y * ancho + x] = y * ancho + (x - d + ancho) % ancho;
+        } else if (tipo == OP_PERMUTAR) {
+            generarPermutacion(tabla, n, static_cast<unsigned int>(k));
+        } else {
+            int* directa = new int[n];
+            generarPermutacion(directa, n, static_cast<unsigned int>(k));
+            invertirPermutacion(directa, tabla, n);
+            delete [] directa;
+        }
+        perms[j] = tabla;
+    }
+    return perms;
+}
+
+void liberarPermutaciones(int** perms, int nPasos) {
+    if (!perms)
+        return;
+    for (int j = 0; j < nPasos; ++j)
+        delete [] perms[j];
+    delete [] perms;
+}
+
+// -----------------------------------------------------------------------------
+// Función permutarPixeles: "gather" lineal sobre los píxeles de salida. Las
+// escrituras son secuenciales; las lecturas siguen la tabla y se anticipan con
+// prefetch unos píxeles adelante para ocultar la latencia de los accesos
+// aleatorios de las permutaciones generadas por semilla.
+// Nota: se probó agrupar los destinos por ventana de origen (conteo por
+// ventanas de 8K y 64K píxeles y un segundo pase que lee solo de esa ventana),
+// pero el pase de conteo y las escrituras dispersas cuestan más de lo que se
+// ahorra en lecturas: con 16M de píxeles y una permutación de generarPermutacion
+// el gather lineal tarda ~280 ms frente a ~700 ms (64K) y ~850 ms (8K), y con 1M
+// de píxeles ~7 ms frente a ~15 ms. El prefetch aporta ~5% sobre el gather sin él.
+void permutarPixeles(const unsigned char* origen, unsigned char* destino,
+                     const int* tabla, int nPixeles) {
+    const int ADELANTO = 16;
+    for (int p = 0; p < nPixeles; ++p) {
+        if (p + ADELANTO < nPixeles)
+            __builtin_prefetch(origen + 3 * tabla[p + ADELANTO]);
+        const unsigned char* src = origen + 3 * tabla[p];
+        unsigned char* dst = destino + 3 * p;
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Agrega un candidato de uno o dos pasos {tipo1, k1, tipo2, k2} (tipo2 < 0 si
+// es de un solo paso). Se cuentan todos aunque no quepan para informar la
+// ambigüedad real.
+static void agregarCandidato(int* candidatos, int* longitudes, int &total, int maxCand,
+                             int tipo1, int k1, int tipo2, int k2) {
+    if (total < maxCand) {
+        int* c = candidatos + total * 2 * CAMPOS_PASO;
+        c[0] = tipo1;
+        c[1] = k1;
+        c[2] = 0;
+        c[3] = tipo2;
+        c[4] = k2;
+        c[5] = 0;
+        longitudes[total] = tipo2 < 0 ? 1 : 2;
+    }
+    ++total;
+}
+
+// -----------------------------------------------------------------------------
+// Función descubrirPorBits: Cada tripleta de enmascaramiento fija el valor
+// exacto de la ventana, así que en lugar de probar operaciones una por una se
+// analiza de qué bit de entrada viene cada bit de salida. Para cada rotación r
+// se acumula con OR, en una sola pasada, en qué bits de salida falla cada
+// relación:
+//   y = rotIzq(x, r)              (difIgual)
+//   y = rotIzq(x, r) ^ c          (difConst, c constante en la ventana)
+//   y = rotIzq(x, r) ^ n          (difRuidoSal)
+//   y = rotIzq(x ^ n, r)          (difRuidoEnt)
+// Un bit en 0 significa que la relación se cumple para ese bit en toda la
+// ventana. Los desplazamientos (combinados con rotación) son una rotación en
+// la que los bits que entran deben valer siempre 0.
+int descubrirPorBits(const unsigned char* x, const unsigned char* n,
+                     const unsigned char* y, int len, int* candidatos,
+                     int* longitudes, int maxCand) {
+    if (len <= 0)
+        return 0;
+    unsigned char difIgual[8] = {0};
+    unsigned char difConst[8] = {0};
+    unsigned char difRuidoSal[8] = {0};
+    unsigned char difRuidoEnt[8] = {0};
+    unsigned char c0[8];
+    unsigned char varY = 0;  // Bits de y que cambian dentro de la ventana
+    unsigned char y0 = y[0];
+    for (int r = 0; r < 8; ++r)
+        c0[r] = static_cast<unsigned char>(y0 ^ brotate_left(x[0], r));
+    for (int k = 0; k < len; ++k) {
+        unsigned char xr = x[k];
+        unsigned char xn = static_cast<unsigned char>(x[k] ^ n[k]);
+        for (int r = 0; r < 8; ++r) {
+            unsigned char rot = brotate_left(xr, r);
+            unsigned char d = static_cast<unsigned char>(y[k] ^ rot);
+            difIgual[r] |= d;
+            difConst[r] |= static_cast<unsigned char>(d ^ c0[r]);
+            difRuidoSal[r] |= static_cast<unsigned char>(d ^ n[k]);
+            difRuidoEnt[r] |= static_cast<unsigned char>(y[k] ^ brotate_left(xn, r));
+        }
+        varY |= static_cast<unsigned char>(y[k] ^ y0);
+    }
+
+    int total = 0;
+    for (int r = 0; r < 8; ++r) {
+        if (r != 0 && difIgual[r] == 0)
+            agregarCandidato(candidatos, longitudes, total, maxCand,
+                             OP_ROT_IZQ, r, -1, 0);
+        if (difConst[r] == 0 && c0[r] != 0) {
+            if (r == 0)
+                agregarCandidato(candidatos, longitudes, total, maxCand,
+                                 OP_XOR_CONST, c0[r], -1, 0);
+            else
+                agregarCandidato(candidatos, longitudes, total, maxCand,
+                                 OP_ROT_IZQ, r, OP_XOR_CONST, c0[r]);
+        }
+        if (difRuidoSal[r] == 0) {
+            if (r == 0)
+                agregarCandidato(candidatos, longitudes, total, maxCand,
+                                 OP_XOR_RUIDO, 0, -1, 0);
+            else
+                agregarCandidato(candidatos, longitudes, total, maxCand,
+                                 OP_ROT_IZQ, r, OP_XOR_RUIDO, 0);
+        }
+        if (r != 0 && difRuidoEnt[r] == 0)
+            agregarCandidato(candidatos, longitudes, total, maxCand,
+                             OP_XOR_RUIDO, 0, OP_ROT_IZQ, r);
+    }
+    // Rotación seguida de desplazamiento: los bits que conservan valor vienen
+    // de una rotación r y los que entran por el desplazamiento son siempre 0
+    for (int d = 1; d < 8; ++d) {
+        unsigned char altos = static_cast<unsigned char>(0xFF << d);
+        unsigned char bajos = static_cast<unsigned char>(0xFF >> d);
+        for (int r = 0; r < 8; ++r) {
+            // rotIzq(x, r - d) << d
+            if ((difIgual[r] & altos) == 0 && ((y0 | varY) & ~altos & 0xFF) == 0) {
+                int rot = (r - d + 8) & 7;
+                if (rot == 0)
+                    agregarCandidato(candidatos, longitudes, total, maxCand,
+                                     OP_DESP_IZQ, d, -1, 0);
+                else
+                    agregarCandidato(candidatos, longitudes, total, maxCand,
+                                     OP_ROT_IZQ, rot, OP_DESP_IZQ, d);
+            }
+            // rotIzq(x, r + d) >> d
+            if ((difIgual[r] & bajos) == 0 && ((y0 | varY) & ~bajos & 0xFF) == 0) {
+                int rot = (r + d) & 7;
+                if (rot == 0)
+                    agregarCandidato(candidatos, longitudes, total, maxCand,
+                                     OP_DESP_DER, d, -1, 0);
+                else
+                    agregarCandidato(candidatos, longitudes, total, maxCand,
+                                     OP_ROT_IZQ, rot, OP_DESP_DER, d);
+            }
+        }
+    }
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// Ventana del flujo del PRNG en las posiciones [seed, seed + len)
+static void ventanaPrng(unsigned char* n, int len, int seed, int semillaPrng) {
+    const int paso[CAMPOS_PASO] = { OP_XOR_PRNG, semillaPrng, PRNG_SPLITMIX64 };
+    memset(n, 0, len);
+    aplicarPaso(n, seed, len, nullptr, 0, paso);
+}
+
+// Función descubrirEtapa: Busca las operaciones que llevan la ventana x a y
+// con cada ruido de la biblioteca y, con semillaPrng >= 0, con el flujo del
+// PRNG como un ruido más (sus candidatos pasan a ser OP_XOR_PRNG). Los
+// candidatos que usan ruido se etiquetan con su id; los que no lo usan se
+// cuentan una sola vez. Si ningún ruido alineado explica la ventana se busca
+// un ruido desplazado (solo en la biblioteca).
+static int descubrirEtapa(const unsigned char* x, const unsigned char* y, int len, int seed,
+                          const unsigned char* const* ruidos, int nRuidos, int semillaPrng,
+                          int tamRuido, const unsigned long long* tabla, int* candidatos,
+                          int* longitudes, int maxCand) {
+    const int MAX_CAND = 32;
+    int propios[MAX_CAND * 2 * CAMPOS_PASO];
+    int longPropios[MAX_CAND];
+    unsigned char* n = new unsigned char[len];
+    int total = 0;
+    // La prueba nRuidos es la del PRNG. Sin biblioteca ni PRNG se prueba una
+    // vez con ruido nulo y se descartan los candidatos que usan ruido
+    int nPruebas = nRuidos + (semillaPrng >= 0 ? 1 : 0);
+    bool sinRuido = nPruebas == 0;
+    if (sinRuido)
+        nPruebas = 1;
+    for (int fase = 0; fase < 2 && total == 0; ++fase) {
+        for (int id = 0; id < nPruebas; ++id) {
+            if (fase == 1 && id >= nRuidos)
+                break;
+            bool esPrng = id == nRuidos && !sinRuido;
+            int encontrados;
+            if (fase == 0) {
+                if (esPrng)
+                    ventanaPrng(n, len, seed, semillaPrng);
+                else
+                    for (int k = 0; k < len; ++k)
+                        n[k] = sinRuido ? 0 : ruidos[id][seed + k];
+                encontrados = tabla ? descubrirPorTabla(tabla, x, n, y, len, propios,
+                                                        longPropios, MAX_CAND)
+                                    : descubrirPorBits(x, n, y, len, propios,
+                                                       longPropios, MAX_CAND);
+            } else {
+                encontrados = descubrirDesplazamientoRuido(x, y, len, seed, ruidos[id],
+                                                           tamRuido, propios,
+                                                           longPropios, MAX_CAND);
+            }
+            for (int c = 0; c < encontrados; ++c) {
+                if (c >= MAX_CAND) {
+                    total += encontrados - MAX_CAND;
+                    break;
+                }
+                int* cand = propios + c * 2 * CAMPOS_PASO;
+                bool usaRuido = false;
+                for (int p = 0; p < longPropios[c]; ++p) {
+                    int* paso = cand + p * CAMPOS_PASO;
+                    if (paso[0] != OP_XOR_RUIDO)
+                        continue;
+                    usaRuido = true;
+                    if (esPrng) {
+                        paso[0] = OP_XOR_PRNG;
+                        paso[1] = semillaPrng;
+                        paso[2] = PRNG_SPLITMIX64;
+                    } else {
+                        paso[2] = id;
+                    }
+                }
+                if ((!usaRuido && id > 0) || (usaRuido && sinRuido))
+                    continue; // Ya contado con el primer ruido, o no hay ruido
+                if (total < maxCand) {
+                    for (int i = 0; i < 2 * CAMPOS_PASO; ++i)
+                        candidatos[total * 2 * CAMPOS_PASO + i] = cand[i];
+                    longitudes[total] = longPropios[c];
+                }
+                ++total;
+            }
+        }
+    }
+    delete [] n;
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// Función descubrirCadena: El archivo de enmascaramiento de mayor índice
+// corresponde a la última transformación aplicada, así que se recorre hacia
+// atrás: se evalúa la cadena encontrada hasta el momento sobre la ventana del
+// siguiente archivo y se deduce la operación que lleva esa ventana a
+// (S[k] - mask[k]) probando cada ruido de la biblioteca (descubrirEtapa). Si
+// nada la explica se repite el análisis por canal para informar qué canales
+// sí se explican.
+// La operación posterior al último desenmascarado no deja rastro en los
+// archivos y no puede deducirse de ellos.
+int descubrirCadena(const unsigned char* img, int dataSize,
+                    const unsigned char* const* ruidos, int nRuidos, int semillaPrng,
+                    int totalMaskBytes, unsigned char** S,
+                    const int* semillas, const int* nPix, int nMascaras,
+                    const unsigned long long* tabla, int* cadena, int maxPasos) {
+    const int MAX_CAND = 32;
+    int candidatos[MAX_CAND * 2 * CAMPOS_PASO];
+    int longitudes[MAX_CAND];
+    unsigned char* x = new unsigned char[totalMaskBytes];
+    unsigned char* n = new unsigned char[totalMaskBytes];
+    unsigned char* y = new unsigned char[totalMaskBytes];
+    int nPasos = 0;
+    for (int m = nMascaras - 1; m >= 0; --m) {
+        int seed = semillas[m];
+        if (!S[m] || seed < 0 || nPix[m] * 3 < totalMaskBytes ||
+            seed + totalMaskBytes > dataSize || nPasos + 3 > maxPasos) {
+            cout << "M" << m + 1 << ".txt: ventana fuera de la imagen." << endl;
+            nPasos = -1;
+            break;
+        }
+        int rango[2] = { seed, seed + totalMaskBytes };
+        evaluarRangos(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes,
+                      S, semillas, nullptr, rango, 1, x);
+        for (int k = 0; k < totalMaskBytes; ++k)
+            y[k] = S[m][k];
+        int total = descubrirEtapa(x, y, totalMaskBytes, seed, ruidos, nRuidos, semillaPrng,
+                                   dataSize, tabla, candidatos, longitudes, MAX_CAND);
+        if (total == 1) {
+            for (int p = 0; p < longitudes[0]; ++p) {
+                for (int c = 0; c < CAMPOS_PASO; ++c)
+                    cadena[nPasos * CAMPOS_PASO + c] = candidatos[p * CAMPOS_PASO + c];
+                ++nPasos;
+            }
+            cadena[nPasos * CAMPOS_PASO] = OP_DESENMASCARAR;
+            cadena[nPasos * CAMPOS_PASO + 1] = m;
+            cadena[nPasos * CAMPOS_PASO + 2] = 0;
+            ++nPasos;
+            continue;
+        }
+        if (total > 1) {
+            cout << "M" << m + 1 << ".txt: etapa ambigua, " << total
+                 << " operaciones explican la ventana:" << endl;
+            for (int c = 0; c < total && c < MAX_CAND; ++c) {
+                cout << "  candidato " << c + 1 << ":" << endl;
+                for (int p = 0; p < longitudes[c]; ++p)
+                    imprimirPaso(candidatos + c * 2 * CAMPOS_PASO + p * CAMPOS_PASO);
+            }
+        } else {
+            cout << "M" << m + 1 << ".txt: ninguna operacion explica la ventana." << endl;
+            // Análisis por canal (R, G, B) con los bytes de la ventana de ese canal
+            // y el ruido principal (id 0, o el flujo del PRNG sin biblioteca)
+            if (nRuidos == 0 && semillaPrng >= 0)
+                ventanaPrng(n, totalMaskBytes, seed, semillaPrng);
+            else
+                for (int k = 0; k < totalMaskBytes; ++k)
+                    n[k] = nRuidos > 0 ? ruidos[0][seed + k] : 0;
+            for (int canal = 0; canal < 3; ++canal) {
+                int len = 0;
+                for (int k = 0; k < totalMaskBytes; ++k) {
+                    if ((seed + k) % 3 != canal)
+                        continue;
+                    x[len] = x[k];
+                    n[len] = n[k];
+                    y[len] = y[k];
+                    ++len;
+                }
+                int enCanal = tabla ? descubrirPorTabla(tabla, x, n, y, len, candidatos,
+                                                        longitudes, MAX_CAND)
+                                    : descubrirPorBits(x, n, y, len, candidatos, longitudes,
+                                                       MAX_CAND);
+                cout << "  canal " << canal << ": " << enCanal << " candidato(s)" << endl;
+                for (int p = 0; enCanal == 1 && p < longitudes[0]; ++p)
+                    imprimirPaso(candidatos + p * CAMPOS_PASO);
+                // Se restaura la ventana completa para el siguiente canal
+                evaluarRangos(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes,
+                              S, semillas, nullptr, rango, 1, x);
+                if (nRuidos == 0 && semillaPrng >= 0)
+                    ventanaPrng(n, totalMaskBytes, seed, semillaPrng);
+                else
+                    for (int k = 0; k < totalMaskBytes; ++k)
+                        n[k] = nRuidos > 0 ? ruidos[0][seed + k] : 0;
+                for (int k = 0; k < totalMaskBytes; ++k)
+                    y[k] = S[m][k];
+            }
+        }
+        nPasos = -1;
+        break;
+    }
+    if (nPasos > 0)
+        cout << "Nota: el paso posterior a M1.txt no se puede deducir de los archivos"
+                " de enmascaramiento." << endl;
+    delete [] x;
+    delete [] n;
+    delete [] y;
+    return nPasos;
+}
+
+// -----------------------------------------------------------------------------
+// Función imprimirPaso: Muestra un paso de la cadena en una línea.
+void imprimirPaso(const int* paso) {
+    const char* nombres[] = { "XOR ruido", "rotacion izquierda", "rotacion derecha",
+                              "desplazamiento izquierda", "desplazamiento derecha",
+                              "desenmascarar M", "rotar filas", "rotar columnas",
+                              "permutar semilla", "permutacion inversa semilla",
+                              "XOR constante", "XOR prng semilla" };
+    int tipo = paso[0];
+    if (tipo < 0 || tipo > OP_XOR_PRNG) {
+        cout << "  (paso desconocido " << tipo << ")" << endl;
+        return;
+    }
+    cout << "  " << nombres[tipo];
+    if (tipo == OP_DESENMASCARAR)
+        cout << paso[1] + 1 << ".txt";
+    else if (tipo != OP_XOR_RUIDO)
+        cout << " " << paso[1];
+    else if (paso[1] != 0)
+        cout << " desplazado " << paso[1];
+    if (tipo == OP_XOR_RUIDO && paso[2] != 0)
+        cout << " (ruido " << paso[2] << ")";
+    cout << endl;
+}
+
+// -----------------------------------------------------------------------------
+// Función generarVocabulario: XOR con cada ruido, XOR con el PRNG si hay
+// semilla, NOT y todas las rotaciones y desplazamientos de 1 a 7 bits.
+int generarVocabulario(int* pasos, int maxPasos, int nRuidos, int semillaPrng) {
+    int n = 0;
+    if (semillaPrng >= 0 && n < maxPasos) {
+        pasos[n * CAMPOS_PASO] = OP_XOR_PRNG;
+        pasos[n * CAMPOS_PASO + 1] = semillaPrng;
+        pasos[n * CAMPOS_PASO + 2] = PRNG_SPLITMIX64;
+        ++n;
+    }
+    for (int id = 1; id < nRuidos && n < maxPasos; ++id) {
+        pasos[n * CAMPOS_PASO] = OP_XOR_RUIDO;
+        pasos[n * CAMPOS_PASO + 1] = 0;
+        pasos[n * CAMPOS_PASO + 2] = id;
+        ++n;
+    }
+    for (int tipo = OP_XOR_RUIDO; tipo <= OP_XOR_CONST; ++tipo) {
+        if (tipo == OP_ROT_DER || tipo == OP_DESENMASCARAR || esPermutacion(tipo))
+            continue; // La rotación derecha ya está cubierta por la izquierda
+        int desde = (tipo == OP_XOR_RUIDO) ? 0 : 1;
+        int hasta = (tipo == OP_XOR_RUIDO) ? 0 : 7;
+        if (tipo == OP_XOR_CONST)
+            desde = hasta = 0xFF;
+        for (int k = desde; k <= hasta && n < maxPasos; ++k) {
+            pasos[n * CAMPOS_PASO] = tipo;
+            pasos[n * CAMPOS_PASO + 1] = k;
+            pasos[n * CAMPOS_PASO + 2] = 0;
+            ++n;
+        }
+    }
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Función buscarCadenaHaz: Se recorre desde el último archivo de enmascaramiento
+// hacia el primero. Cada cadena del haz se extiende con cada operación del
+// vocabulario más el desenmascarado de la etapa; el puntaje de la extensión es
+// la proporción de bytes de la ventana que coinciden con (S[k] - mask[k]). Se
+// conservan las anchoHaz extensiones con mayor puntaje acumulado y el resto se
+// descarta. Las cadenas del haz se evalúan en paralelo, una por hilo, porque
+// cada una solo lee la imagen y escribe su propia fila de puntajes. Todas las
+// operaciones del vocabulario se prueban de una vez con evaluarPlanos.
+int buscarCadenaHaz(const unsigned char* img, int dataSize,
+                    const unsigned char* const* ruidos, int nRuidos, int semillaPrng,
+                    int totalMaskBytes, unsigned char** S,
+                    const int* semillas, const int* nPix, int nMascaras, int anchoHaz,
+                    int* cadena, int maxPasos, double &puntaje) {
+    if (anchoHaz < 1)
+        anchoHaz = 1;
+    if (2 * nMascaras > maxPasos || totalMaskBytes <= 0)
+        return -1;
+    const int MAX_VOC = 32;
+    int vocabulario[MAX_VOC * CAMPOS_PASO];
+    int nVoc = generarVocabulario(vocabulario, MAX_VOC, nRuidos, semillaPrng);
+
+    // Haz actual y siguiente: anchoHaz cadenas de hasta maxPasos pasos
+    int fila = maxPasos * CAMPOS_PASO;
+    int* haz = new int[anchoHaz * fila];
+    int* siguiente = new int[anchoHaz * fila];
+    int* longitud = new int[anchoHaz];
+    int* longitudSig = new int[anchoHaz];
+    double* acumulado = new double[anchoHaz];
+    double* acumuladoSig = new double[anchoHaz];
+    double* puntajes = new double[anchoHaz * nVoc];
+    int nHaz = 1;
+    longitud[0] = 0;
+    acumulado[0] = 0.0;
+
+    int nHilos = QThread::idealThreadCount();
+    if (nHilos < 1)
+        nHilos = 1;
+    QThread** hilos = new QThread*[nHilos];
+
+    for (int m = nMascaras - 1; m >= 0; --m) {
+        int seed = semillas[m];
+        if (!S[m] || seed < 0 || nPix[m] * 3 < totalMaskBytes ||
+            seed + totalMaskBytes > dataSize) {
+            cout << "M" << m + 1 << ".txt: ventana fuera de la imagen." << endl;
+            nHaz = 0;
+            break;
+        }
+        // Cada hilo evalúa las cadenas b = t, t + nActivos, ... del haz. No se
+        // crean más hilos que cadenas: la primera etapa tiene una sola.
+        int nActivos = nHaz < nHilos ? nHaz : nHilos;
+        for (int t = 0; t < nActivos; ++t) {
+            hilos[t] = QThread::create([=]() {
+                unsigned char* x = new unsigned char[totalMaskBytes];
+                unsigned char* n = new unsigned char[nRuidos * totalMaskBytes];
+                unsigned char* y = new unsigned char[totalMaskBytes];
+                unsigned char* flujo = nullptr;
+                if (semillaPrng >= 0) {
+                    flujo = new unsigned char[totalMaskBytes];
+                    ventanaPrng(flujo, totalMaskBytes, seed, semillaPrng);
+                }
+                int nPal = (totalMaskBytes + 63) / 64;
+                unsigned long long* mapas = new unsigned long long[nVoc * nPal];
+                int rango[2] = { seed, seed + totalMaskBytes };
+                for (int id = 0; id < nRuidos; ++id)
+                    for (int k = 0; k < totalMaskBytes; ++k)
+                        n[id * totalMaskBytes + k] = ruidos[id][seed + k];
+                for (int k = 0; k < totalMaskBytes; ++k)
+                    y[k] = S[m][k];
+                for (int b = t; b < nHaz; b += nActivos) {
+                    evaluarRangos(img, dataSize, ruidos, haz + b * fila, longitud[b],
+                                  totalMaskBytes, S, semillas, nullptr, rango, 1, x);
+                    evaluarPlanos(x, n, nRuidos, flujo, y, totalMaskBytes, vocabulario, nVoc,
+                                  mapas);
+                    for (int c = 0; c < nVoc; ++c) {
+                        int iguales = 0;
+                        for (int w = 0; w < nPal; ++w)
+                            iguales += __builtin_popcountll(mapas[c * nPal + w]);
+                        puntajes[b * nVoc + c] =
+                            static_cast<double>(iguales) / totalMaskBytes;
+                    }
+                }
+                delete [] mapas;
+                delete [] flujo;
+                delete [] n;
+                delete [] y;
+                delete [] x;
+            });
+            hilos[t]->start();
+        }
+        for (int t = 0; t < nActivos; ++t) {
+            hilos[t]->wait();
+            delete hilos[t];
+        }
+
+        // Selección de las mejores extensiones (selección parcial)
+        int nSig = 0;
+        int total = nHaz * nVoc;
+        for (int elegido = 0; elegido < anchoHaz && elegido < total; ++elegido) {
+            int mejor = -1;
+            for (int e = 0; e < total; ++e) {
+                if (puntajes[e] < 0.0)
+                    continue;
+                if (mejor < 0 || acumulado[e / nVoc] + puntajes[e] >
+                                 acumulado[mejor / nVoc] + puntajes[mejor])
+                    mejor = e;
+            }
+            if (mejor < 0)
+                break;
+            int b = mejor / nVoc;
+            int c = mejor % nVoc;
+            int* destino = siguiente + nSig * fila;
+            for (int i = 0; i < longitud[b] * CAMPOS_PASO; ++i)
+                destino[i] = haz[b * fila + i];
+            int n = longitud[b];
+            for (int i = 0; i < CAMPOS_PASO; ++i)
+                destino[n * CAMPOS_PASO + i] = vocabulario[c * CAMPOS_PASO + i];
+            destino[(n + 1) * CAMPOS_PASO] = OP_DESENMASCARAR;
+            destino[(n + 1) * CAMPOS_PASO + 1] = m;
+            destino[(n + 1) * CAMPOS_PASO + 2] = 0;
+            longitudSig[nSig] = n + 2;
+            acumuladoSig[nSig] = acumulado[b] + puntajes[mejor];
+            puntajes[mejor] = -1.0; // Ya elegido
+            ++nSig;
+        }
+        int* t1 = haz; haz = siguiente; siguiente = t1;
+        int* t2 = longitud; longitud = longitudSig; longitudSig = t2;
+        double* t3 = acumulado; acumulado = acumuladoSig; acumuladoSig = t3;
+        nHaz = nSig;
+    }
+
+    // El haz queda ordenado por puntaje, la primera cadena es la mejor
+    int n = -1;
+    if (nHaz > 0) {
+        n = longitud[0];
+        for (int i = 0; i < n * CAMPOS_PASO; ++i)
+            cadena[i] = haz[i];
+        puntaje = acumulado[0] / nMascaras;
+    }
+    delete [] hilos;
+    delete [] puntajes;
+    delete [] acumuladoSig;
+    delete [] acumulado;
+    delete [] longitudSig;
+    delete [] longitud;
+    delete [] siguiente;
+    delete [] haz;
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Función transponerPlanos: Cada grupo de 8 bytes se trata como una matriz de
+// 8x8 bits y se transpone con tres intercambios de bloques (2x2, 4x4, 8x8), así
+// el byte b del resultado reúne el bit b de los 8 bytes del grupo.
+int transponerPlanos(const unsigned char* v, int len, unsigned long long* planos) {
+    int nPal = (len + 63) / 64;
+    for (int i = 0; i < 8 * nPal; ++i)
+        planos[i] = 0;
+    for (int g = 0; g < len; g += 8) {
+        unsigned long long m = 0;
+        for (int j = 0; j < 8 && g + j < len; ++j)
+            m |= static_cast<unsigned long long>(v[g + j]) << (8 * j);
+        unsigned long long t;
+        t = (m ^ (m >> 7)) & 0x00AA00AA00AA00AAULL;
+        m ^= t ^ (t << 7);
+        t = (m ^ (m >> 14)) & 0x0000CCCC0000CCCCULL;
+        m ^= t ^ (t << 14);
+        t = (m ^ (m >> 28)) & 0x00000000F0F0F0F0ULL;
+        m ^= t ^ (t << 28);
+        int w = g >> 6;
+        int desp = g & 63;
+        for (int b = 0; b < 8; ++b)
+            planos[b * nPal + w] |= ((m >> (8 * b)) & 0xFFULL) << desp;
+    }
+    return nPal;
+}
+
+// -----------------------------------------------------------------------------
+// Función evaluarPlanos: Con la ventana en planos de bits, una rotación o un
+// desplazamiento es solo un cambio de índice de plano, un NOT o XOR con una
+// constante invierte planos completos y el XOR con el ruido es un XOR de
+// planos (solo ruido alineado: n debe ser el ruido en las mismas posiciones).
+// Cada candidato se evalúa así sobre 64 bytes por instrucción y su
+// coincidencia es el AND de los 8 planos de ~(salida ^ esperado).
+int evaluarPlanos(const unsigned char* x, const unsigned char* n, int nRuidos,
+                  const unsigned char* flujo, const unsigned char* y, int len,
+                  const int* vocabulario, int nVoc, unsigned long long* coincidencias) {
+    int nPal = (len + 63) / 64;
+    unsigned long long* px = new unsigned long long[8 * nPal];
+    // Planos de los ruidos y, en el lugar nRuidos, los del flujo del PRNG
+    unsigned long long* pn = new unsigned long long[8 * nPal * (nRuidos + 1)];
+    unsigned long long* py = new unsigned long long[8 * nPal];
+    transponerPlanos(x, len, px);
+    for (int id = 0; id < nRuidos; ++id)
+        transponerPlanos(n + id * len, len, pn + id * 8 * nPal);
+    if (flujo)
+        transponerPlanos(flujo, len, pn + nRuidos * 8 * nPal);
+    transponerPlanos(y, len, py);
+    for (int c = 0; c < nVoc; ++c) {
+        int tipo = vocabulario[c * CAMPOS_PASO];
+        int k = vocabulario[c * CAMPOS_PASO + 1];
+        for (int w = 0; w < nPal; ++w) {
+            unsigned long long valido = ~0ULL;
+            if (w == nPal - 1 && (len & 63) != 0)
+                valido = (1ULL << (len & 63)) - 1;
+            unsigned long long igual = valido;
+            for (int b = 0; b < 8; ++b) {
+                unsigned long long sal = 0;
+                int id = vocabulario[c * CAMPOS_PASO + 2];
+                if (tipo == OP_XOR_RUIDO && k == 0 && id < nRuidos) {
+                    sal = px[b * nPal + w] ^ pn[(id * 8 + b) * nPal + w];
+                } else if (tipo == OP_XOR_PRNG && flujo) {
+                    sal = px[b * nPal + w] ^ pn[(nRuidos * 8 + b) * nPal + w];
+                } else if (tipo == OP_ROT_IZQ || tipo == OP_ROT_DER) {
+                    int r = (tipo == OP_ROT_IZQ) ? (k & 7) : ((8 - (k & 7)) & 7);
+                    sal = px[((b - r + 8) & 7) * nPal + w];
+                } else if (tipo == OP_DESP_IZQ) {
+                    sal = (b >= k) ? px[(b - k) * nPal + w] : 0;
+                } else if (tipo == OP_DESP_DER) {
+                    sal = (b + k < 8) ? px[(b + k) * nPal + w] : 0;
+                } else if (tipo == OP_XOR_CONST) {
+                    sal = px[b * nPal + w] ^ (((k >> b) & 1) ? ~0ULL : 0ULL);
+                } else {
+                    igual = 0; // No es una operación local al byte
+                    break;
+                }
+                igual &= ~(sal ^ py[b * nPal + w]);
+            }
+            coincidencias[c * nPal + w] = igual;
+        }
+    }
+    delete [] px;
+    delete [] pn;
+    delete [] py;
+    return nPal;
+}
+
+// -----------------------------------------------------------------------------
+// Función generarFuncionesTabla: La identidad va primero para que f(x ^ n)
+// con f = identidad represente el XOR con el ruido solo.
+int generarFuncionesTabla(int* funciones, int maxFunciones) {
+    const int MAX_VOC = 64;
+    int vocabulario[MAX_VOC * CAMPOS_PASO];
+    int nVoc = generarVocabulario(vocabulario, MAX_VOC, 1, -1);
+    int n = 0;
+    if (maxFunciones > 0) {
+        funciones[0] = -1;
+        funciones[1] = 0;
+        funciones[2] = 0;
+        n = 1;
+    }
+    for (int v = 0; v < nVoc && n < maxFunciones && n < 64; ++v) {
+        if (vocabulario[v * CAMPOS_PASO] == OP_XOR_RUIDO)
+            continue;
+        for (int c = 0; c < CAMPOS_PASO; ++c)
+            funciones[n * CAMPOS_PASO + c] = vocabulario[v * CAMPOS_PASO + c];
+        ++n;
+    }
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Función construirTablaPares: 65536 entradas de 64 bits (512 KiB). Cada
+// función de un byte se evalúa sobre los 256 valores posibles una sola vez.
+unsigned long long* construirTablaPares() {
+    int funciones[64 * CAMPOS_PASO];
+    int nFunc = generarFuncionesTabla(funciones, 64);
+    unsigned long long* tabla = new unsigned long long[256 * 256];
+    for (int i = 0; i < 256 * 256; ++i)
+        tabla[i] = 0;
+    for (int f = 0; f < nFunc; ++f) {
+        for (int x = 0; x < 256; ++x) {
+            unsigned char v = static_cast<unsigned char>(x);
+            if (funciones[f * CAMPOS_PASO] >= 0)
+                aplicarPaso(&v, 0, 1, nullptr, 0, funciones + f * CAMPOS_PASO);
+            tabla[(x << 8) | v] |= 1ULL << f;
+        }
+    }
+    return tabla;
+}
+
+// -----------------------------------------------------------------------------
+// Función descubrirPorTabla: En lugar de ejecutar operaciones, cada par
+// (x[k], y[k]) de la ventana se busca en la tabla y se hace AND de los
+// conjuntos de funciones compatibles. Se lleva un conjunto para f(x) y otro
+// para f(x ^ n); la búsqueda termina en cuanto ambos quedan vacíos.
+int descubrirPorTabla(const unsigned long long* tabla, const unsigned char* x,
+                      const unsigned char* n, const unsigned char* y, int len,
+                      int* candidatos, int* longitudes, int maxCand) {
+    if (len <= 0)
+        return 0;
+    int funciones[64 * CAMPOS_PASO];
+    int nFunc = generarFuncionesTabla(funciones, 64);
+    unsigned long long directas = ~0ULL;
+    unsigned long long conRuido = ~0ULL;
+    for (int k = 0; k < len && (directas | conRuido) != 0; ++k) {
+        directas &= tabla[(x[k] << 8) | y[k]];
+        conRuido &= tabla[((x[k] ^ n[k]) << 8) | y[k]];
+    }
+    directas &= ~1ULL; // La identidad sola no es una operación
+    int total = 0;
+    for (int f = 0; f < nFunc; ++f) {
+        const int* fn = funciones + f * CAMPOS_PASO;
+        if ((directas >> f) & 1ULL)
+            agregarCandidato(candidatos, longitudes, total, maxCand,
+                             fn[0], fn[1], -1, 0);
+        if ((conRuido >> f) & 1ULL) {
+            if (f == 0)
+                agregarCandidato(candidatos, longitudes, total, maxCand,
+                                 OP_XOR_RUIDO, 0, -1, 0);
+            else
+                agregarCandidato(candidatos, longitudes, total, maxCand,
+                                 OP_XOR_RUIDO, 0, fn[0], fn[1]);
+        }
+    }
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// Función buscarEnRuido: Se descarta cada posición comparando primero 8 bytes
+// como una palabra de 64 bits; solo las posiciones que pasan ese filtro se
+// comparan completas (con vuelta al inicio del ruido).
+int buscarEnRuido(const unsigned char* d, int len, const unsigned char* imRand,
+                  int tamRuido, int* posiciones, int maxPos) {
+    if (len <= 0 || tamRuido <= 0)
+        return 0;
+    unsigned long long cabeza = 0;
+    int nCabeza = len < 8 ? len : 8;
+    memcpy(&cabeza, d, nCabeza);
+    int encontradas = 0;
+    for (int p = 0; p < tamRuido; ++p) {
+        if (p + 8 <= tamRuido) {
+            unsigned long long palabra = 0;
+            memcpy(&palabra, imRand + p, nCabeza);
+            if (palabra != cabeza)
+                continue;
+        }
+        int k = 0;
+        int pos = p;
+        while (k < len && imRand[pos] == d[k]) {
+            ++k;
+            if (++pos == tamRuido)
+                pos = 0;
+        }
+        if (k < len)
+            continue;
+        if (encontradas < maxPos)
+            posiciones[encontradas] = p;
+        ++encontradas;
+    }
+    return encontradas;
+}
+
+// -----------------------------------------------------------------------------
+// Función descubrirDesplazamientoRuido: Si y = rotIzq(x, r) ^ ruido[i + desp]
+// entonces el ruido usado es y ^ rotIzq(x, r); si y = rotIzq(x ^ ruido, r)
+// entonces es x ^ rotDer(y, r). Para cada rotación se reconstruye ese bloque
+// de ruido y se busca en imRand; su posición da el desplazamiento.
+int descubrirDesplazamientoRuido(const unsigned char* x, const unsigned char* y, int len,
+                                 int seed, const unsigned char* imRand, int tamRuido,
+                                 int* candidatos, int* longitudes, int maxCand) {
+    if (len <= 0)
+        return 0;
+    const int MAX_POS = 4;
+    int posiciones[MAX_POS];
+    unsigned char* d = new unsigned char[len];
+    int total = 0;
+    for (int forma = 0; forma < 2; ++forma) {
+        for (int r = 0; r < 8; ++r) {
+            if (forma == 1 && r == 0)
+                continue; // Igual a la forma 0 sin rotación
+            for (int k = 0; k < len; ++k)
+                d[k] = forma == 0 ? static_cast<unsigned char>(y[k] ^ brotate_left(x[k], r))
+                                  : static_cast<unsigned char>(x[k] ^ brotate_left(y[k], 8 - r));
+            int n = buscarEnRuido(d, len, imRand, tamRuido, posiciones, MAX_POS);
+            for (int i = 0; i < n && i < MAX_POS; ++i) {
+                int desp = ((posiciones[i] - seed) % tamRuido + tamRuido) % tamRuido;
+                if (desp == 0)
+                    continue; // El caso alineado ya lo cubren los otros métodos
+                if (r == 0)
+                    agregarCandidato(candidatos, longitudes, total, maxCand,
+                                     OP_XOR_RUIDO, desp, -1, 0);
+                else if (forma == 0)
+                    agregarCandidato(candidatos, longitudes, total, maxCand,
+                                     OP_ROT_IZQ, r, OP_XOR_RUIDO, desp);
+                else
+                    agregarCandidato(candidatos, longitudes, total, maxCand,
+                                     OP_XOR_RUIDO, desp, OP_ROT_IZQ, r);
+            }
+            if (n > MAX_POS)
+                total += n - MAX_POS;
+        }
+    }
+    delete [] d;
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// Funciones de hash: misma estructura que xxHash64. Los 4 carriles consumen
+// 8 bytes cada uno por vuelta (32 bytes) y no dependen entre sí, de modo que
+// el procesador los ejecuta en paralelo y el compilador puede vectorizarlos.
+// Al final se combinan y se mezcla la cola que no completa 32 bytes.
+static const unsigned long long PRIMO_H1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long PRIMO_H2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long PRIMO_H3 = 0x165667B19E3779F9ULL;
+static const unsigned long long PRIMO_H4 = 0x85EBCA77C2B2AE63ULL;
+static const unsigned long long PRIMO_H5 = 0x27D4EB2F165667C5ULL;
+
+static inline unsigned long long rotl64(unsigned long long v, int k) {
+    return (v << k) | (v >> (64 - k));
+}
+
+static inline unsigned long long rondaHash(unsigned long long acc, unsigned long long v) {
+    acc += v * PRIMO_H2;
+    acc = rotl64(acc, 31);
+    return acc * PRIMO_H1;
+}
+
+void hashIniciar(unsigned long long* estado) {
+    estado[0] = PRIMO_H1 + PRIMO_H2;
+    estado[1] = PRIMO_H2;
+    estado[2] = 0;
+    estado[3] = 0 - PRIMO_H1;
+}
+
+void hashBloques(unsigned long long* estado, const unsigned char* datos, long long len) {
+    unsigned long long a = estado[0], b = estado[1], c = estado[2], d = estado[3];
+    for (long long i = 0; i + 32 <= len; i += 32) {
+        unsigned long long v[4];
+        memcpy(v, datos + i, 32);
+        a = rondaHash(a, v[0]);
+        b = rondaHash(b, v[1]);
+        c = rondaHash(c, v[2]);
+        d = rondaHash(d, v[3]);
+    }
+    estado[0] = a;
+    estado[1] = b;
+    estado[2] = c;
+    estado[3] = d;
+}
+
+unsigned long long hashFinal(const unsigned long long* estado, const unsigned char* cola,
+                             int lenCola, long long total) {
+    unsigned long long h;
+    if (total >= 32) {
+        h = rotl64(estado[0], 1) + rotl64(estado[1], 7) +
+            rotl64(estado[2], 12) + rotl64(estado[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            h ^= rondaHash(0, estado[i]);
+            h = h * PRIMO_H1 + PRIMO_H4;
+        }
+    } else {
+        h = PRIMO_H5;
+    }
+    h += static_cast<unsigned long long>(total);
+    int i = 0;
+    for (; i + 8 <= lenCola; i += 8) {
+        unsigned long long v;
+        memcpy(&v, cola + i, 8);
+        h ^= rondaHash(0, v);
+        h = rotl64(h, 27) * PRIMO_H1 + PRIMO_H4;
+    }
+    for (; i < lenCola; ++i) {
+        h ^= cola[i] * PRIMO_H5;
+        h = rotl64(h, 11) * PRIMO_H1;
+    }
+    h ^= h >> 33;
+    h *= PRIMO_H2;
+    h ^= h >> 29;
+    h *= PRIMO_H3;
+    h ^= h >> 32;
+    return h;
+}
+
+unsigned long long hashBytes(const unsigned char* datos, long long len) {
+    unsigned long long estado[4];
+    hashIniciar(estado);
+    long long bloques = len & ~31LL;
+    hashBloques(estado, datos, bloques);
+    return hashFinal(estado, datos + bloques, static_cast<int>(len - bloques), len);
+}
+
+// -----------------------------------------------------------------------------
+// Función hashArchivo: Lee el archivo en partes de 1 MiB (múltiplo de 32) y
+// las va encadenando en el estado del hash, sin cargarlo completo en memoria.
+bool hashArchivo(const char* ruta, unsigned long long &h) {
+    ifstream f(ruta, ios::binary);
+    if (!f)
+        return false;
+    const int PARTE = 1 << 20;
+    unsigned char* buf = new unsigned char[PARTE];
+    unsigned long long estado[4];
+    hashIniciar(estado);
+    long long total = 0;
+    int leidos = 0;
+    while (true) {
+        f.read(reinterpret_cast<char*>(buf), PARTE);
+        leidos = static_cast<int>(f.gcount());
+        total += leidos;
+        if (leidos < PARTE)
+            break;
+        hashBloques(estado, buf, PARTE);
+    }
+    int bloques = leidos & ~31;
+    hashBloques(estado, buf, bloques);
+    h = hashFinal(estado, buf + bloques, leidos - bloques, total);
+    delete [] buf;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Función claveCaso: Combina los hashes de los archivos del caso y un valor
+// extra (por ejemplo la semilla del PRNG). Retorna 0 si falta algún archivo.
+unsigned long long claveCaso(const char* const* archivos, int nArchivos, long long extra) {
+    unsigned long long hashes[16];
+    if (nArchivos > 15)
+        return 0;
+    for (int i = 0; i < nArchivos; ++i)
+        if (!hashArchivo(archivos[i], hashes[i]))
+            return 0;
+    hashes[nArchivos] = static_cast<unsigned long long>(extra);
+    unsigned long long clave = hashBytes(reinterpret_cast<const unsigned char*>(hashes),
+                                         8LL * (nArchivos + 1));
+    return clave != 0 ? clave : 1;
+}
+
+// -----------------------------------------------------------------------------
+// Función buscarEnCache: Recorre el archivo de caché línea por línea buscando
+// la clave (las líneas que no se pueden leer se ignoran). Solo cuenta como
+// acierto si la imagen resultante registrada existe y su hash sigue siendo el
+// guardado, así una I_D.bmp sobrescrita o de otro caso no se da por buena.
+bool buscarEnCache(const char* rutaCache, unsigned long long clave, char* rutaSalida,
+                   int maxRuta, int* cadena, int &nPasos, int maxPasos) {
+    ifstream f(rutaCache);
+    if (!f)
+        return false;
+    string linea;
+    while (getline(f, linea)) {
+        const char* p = linea.c_str();
+        char* fin = nullptr;
+        unsigned long long c = strtoull(p, &fin, 16);
+        if (fin == p || c != clave)
+            continue;
+        p = fin;
+        unsigned long long hashGuardado = strtoull(p, &fin, 16);
+        if (fin == p)
+            continue;
+        p = fin;
+        while (*p == ' ')
+            ++p;
+        const char* inicioRuta = p;
+        const char* finRuta = p;
+        while (*finRuta && *finRuta != ' ')
+            ++finRuta;
+        int lenRuta = static_cast<int>(finRuta - inicioRuta);
+        if (lenRuta == 0 || lenRuta >= maxRuta)
+            continue;
+        p = finRuta;
+        long n = strtol(p, &fin, 10);
+        if (fin == p || n < 0 || n > maxPasos)
+            continue;
+        p = fin;
+        bool completa = true;
+        for (int i = 0; i < n * CAMPOS_PASO && completa; ++i) {
+            cadena[i] = static_cast<int>(strtol(p, &fin, 10));
+            completa = fin != p;
+            p = fin;
+        }
+        if (!completa)
+            continue;
+        memcpy(rutaSalida, inicioRuta, lenRuta);
+        rutaSalida[lenRuta] = '\0';
+        unsigned long long hashActual = 0;
+        if (!hashArchivo(rutaSalida, hashActual) || hashActual != hashGuardado)
+            continue;
+        nPasos = static_cast<int>(n);
+        return true;
+    }
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+// Función guardarEnCache: Agrega una línea al final del archivo de caché con el
+// hash de la imagen resultante, que buscarEnCache vuelve a comprobar.
+void guardarEnCache(const char* rutaCache, unsigned long long clave, unsigned long long hashSalida,
+                    const char* rutaSalida, const int* cadena, int nPasos) {
+    ofstream f(rutaCache, ios::app);
+    if (!f)
+        return;
+    f << hex << clave << " " << hashSalida << dec << " " << rutaSalida << " " << nPasos;
+    for (int i = 0; i < nPasos * CAMPOS_PASO; ++i)
+        f << " " << cadena[i];
+    f << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Función agregarRuido: El índice usa sondeo lineal sobre TAM_INDICE_RUIDO
+// posiciones (el doble del máximo de ruidos), así que una búsqueda revisa en
+// promedio una o dos posiciones.
+int agregarRuido(unsigned char* pixeles, int dataSize, unsigned char** ruidos,
+                 unsigned long long* hashes, int* indice, int &nRuidos) {
+    unsigned long long h = hashBytes(pixeles, dataSize);
+    int existente = buscarRuidoPorHash(indice, hashes, h);
+    if (existente >= 0 && memcmp(ruidos[existente], pixeles, dataSize) == 0)
+        return existente;
+    if (nRuidos >= MAX_RUIDOS)
+        return -1;
+    int id = nRuidos++;
+    ruidos[id] = pixeles;
+    hashes[id] = h;
+    int pos = static_cast<int>(h & (TAM_INDICE_RUIDO - 1));
+    while (indice[pos] >= 0)
+        pos = (pos + 1) & (TAM_INDICE_RUIDO - 1);
+    indice[pos] = id;
+    return id;
+}
+
+int buscarRuidoPorHash(const int* indice, const unsigned long long* hashes,
+                       unsigned long long h) {
+    int pos = static_cast<int>(h & (TAM_INDICE_RUIDO - 1));
+    while (indice[pos] >= 0) {
+        if (hashes[indice[pos]] == h)
+            return indice[pos];
+        pos = (pos + 1) & (TAM_INDICE_RUIDO - 1);
+    }
+    return -1;
+}
+
+void liberarRuidos(unsigned char** ruidos, int nRuidos) {
+    for (int id = 0; id < nRuidos; ++id)
+        liberarPixeles(ruidos[id]);
+}
+
+// -----------------------------------------------------------------------------
+// Función cadenaDelCaso: Copia la cadena de operaciones inversas descrita en
+// main y, con el PRNG, cambia sus XOR con ruido por XOR con el flujo.
+int cadenaDelCaso(int* cadena, int semillaPrng) {
+    const int nPasos = 5;
+    const int fija[nPasos * CAMPOS_PASO] = {
+        OP_XOR_RUIDO,     0, 0,
+        OP_DESENMASCARAR, 1, 0,
+        OP_ROT_IZQ,       3, 0,
+        OP_DESENMASCARAR, 0, 0,
+        OP_XOR_RUIDO,     0, 0
+    };
+    for (int i = 0; i < nPasos * CAMPOS_PASO; ++i)
+        cadena[i] = fija[i];
+    if (semillaPrng >= 0) {
+        for (int j = 0; j < nPasos; ++j) {
+            if (cadena[j * CAMPOS_PASO] != OP_XOR_RUIDO)
+                continue;
+            cadena[j * CAMPOS_PASO] = OP_XOR_PRNG;
+            cadena[j * CAMPOS_PASO + 1] = semillaPrng;
+            cadena[j * CAMPOS_PASO + 2] = PRNG_SPLITMIX64;
+        }
+    }
+    return nPasos;
+}
+
+// -----------------------------------------------------------------------------
+// Función cargarCadena: Lee los pasos de tres enteros y comprueba que cada uno
+// sea aplicable (tipo conocido, archivo de enmascaramiento existente,
+// rotaciones y desplazamientos de 0 a 7 bits).
+int cargarCadena(const char* ruta, int* cadena, int maxPasos, int nMascaras) {
+    ifstream f(ruta);
+    if (!f) {
+        cerr << "Error al abrir " << ruta << endl;
+        return -1;
+    }
+    int nPasos = 0;
+    string linea;
+    while (getline(f, linea)) {
+        size_t inicio = linea.find_first_not_of(" \t\r");
+        if (inicio == string::npos || linea[inicio] == '#')
+            continue;
+        int paso[CAMPOS_PASO];
+        int leidos = sscanf(linea.c_str(), "%d %d %d", &paso[0], &paso[1], &paso[2]);
+        int tipo = paso[0];
+        bool bien = leidos == CAMPOS_PASO && nPasos < maxPasos && tipo >= 0 &&
+                    tipo <= OP_XOR_PRNG;
+        if (bien && tipo == OP_DESENMASCARAR)
+            bien = paso[1] >= 0 && paso[1] < nMascaras;
+        if (bien && tipo >= OP_ROT_IZQ && tipo <= OP_DESP_DER)
+            bien = paso[1] >= 0 && paso[1] <= 7;
+        if (bien && (tipo == OP_XOR_RUIDO || tipo == OP_XOR_PRNG))
+            bien = paso[2] >= 0 && (tipo != OP_XOR_PRNG || paso[2] == PRNG_SPLITMIX64);
+        if (!bien) {
+            cerr << ruta << ": paso invalido en la linea \"" << linea << "\"" << endl;
+            return -1;
+        }
+        for (int c = 0; c < CAMPOS_PASO; ++c)
+            cadena[nPasos * CAMPOS_PASO + c] = paso[c];
+        ++nPasos;
+    }
+    return nPasos;
+}
+
+bool guardarCadena(const char* ruta, const int* cadena, int nPasos, const char* comentario) {
+    ofstream f(ruta);
+    if (!f)
+        return false;
+    f << "# Cadena inversa: tipo parametro reservado\n";
+    if (comentario)
+        f << "# " << comentario << "\n";
+    for (int j = 0; j < nPasos; ++j)
+        f << cadena[j * CAMPOS_PASO] << " " << cadena[j * CAMPOS_PASO + 1] << " "
+          << cadena[j * CAMPOS_PASO + 2] << "\n";
+    return static_cast<bool>(f);
+}
+
+// -----------------------------------------------------------------------------
+// Función decodificarEnMemoria: La verificación se hace antes de tocar la
+// imagen, así un caso inválido no deja la imagen a medio aplicar.
+int decodificarEnMemoria(unsigned char* img, int ancho, int alto,
+                         const unsigned char* const* ruidos, const int* cadena, int nPasos,
+                         int totalMaskBytes, unsigned char** S, const int* semillas,
+                         const int* nPix, const int* perfil) {
+    int dataSize = ancho * alto * 3;
+    int** perms = prepararPermutaciones(cadena, nPasos, ancho, alto);
+    int fallo = verificarVentanas(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes, S,
+                                  semillas, nPix, perms);
+    if (fallo < 0)
+        ejecutarCadenaOptimizada(img, dataSize, ruidos, cadena, nPasos, totalMaskBytes,
+                                 S, semillas, perms, perfil);
+    liberarPermutaciones(perms, nPasos);
+    return fallo;
+}
+
+// Carga los archivos de un caso. Si algo falla libera lo que ya cargó y
+// retorna false.
+static bool cargarCaso(const char* carpeta, unsigned char* &img, unsigned char* &imRand,
+                       unsigned char* &mask, unsigned char** S, int* semillas, int* nPix,
+                       int &ancho, int &alto, int &totalMaskBytes) {
+    string dir = string(carpeta) + "/";
+    int w2 = 0, h2 = 0, mi = 0, mj = 0;
+    img = loadPixels(QString((dir + "P3.bmp").c_str()), ancho, alto);
+    imRand = img ? loadPixels(QString((dir + "I_M.bmp").c_str()), w2, h2) : nullptr;
+    mask = imRand ? loadPixels(QString((dir + "M.bmp").c_str()), mi, mj) : nullptr;
+    S[0] = mask ? loadSeedMasking((dir + "M1.txt").c_str(), semillas[0], nPix[0], mask,
+                                  mi * mj * 3, false) : nullptr;
+    S[1] = S[0] ? loadSeedMasking((dir + "M2.txt").c_str(), semillas[1], nPix[1], mask,
+                                  mi * mj * 3, false) : nullptr;
+    if (S[1] && (ancho != w2 || alto != h2))
+        cerr << "Error: Las imagenes deben tener las mismas dimensiones." << endl;
+    if (!S[1] || ancho != w2 || alto != h2) {
+        liberarPixeles(img);
+        liberarPixeles(imRand);
+        liberarPixeles(mask);
+        delete [] S[0];
+        delete [] S[1];
+        return false;
+    }
+    totalMaskBytes = mi * mj * 3;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Función decodificarCaso: Todo lo que usa vive en variables locales de la
+// llamada; la imagen resultante pasa a ser del llamador.
+unsigned char* decodificarCaso(const char* carpeta, const int* cadena, int nPasos,
+                               const int* perfil, int &ancho, int &alto) {
+    unsigned char* img = nullptr;
+    unsigned char* imRand = nullptr;
+    unsigned char* mask = nullptr;
+    unsigned char* S[2] = { nullptr, nullptr };
+    int semillas[2] = { 0, 0 };
+    int nPix[2] = { 0, 0 };
+    int totalMaskBytes = 0;
+    if (!cargarCaso(carpeta, img, imRand, mask, S, semillas, nPix, ancho, alto, totalMaskBytes))
+        return nullptr;
+    const unsigned char* ruidos[1] = { imRand };
+    int fallo = decodificarEnMemoria(img, ancho, alto, ruidos, cadena, nPasos, totalMaskBytes,
+                                     S, semillas, nPix, perfil);
+    liberarPixeles(imRand);
+    liberarPixeles(mask);
+    delete [] S[0];
+    delete [] S[1];
+    if (fallo >= 0) {
+        liberarPixeles(img);
+        return nullptr;
+    }
+    return img;
+}
+
+// -----------------------------------------------------------------------------
+// Función verificarConcurrencia: La referencia se obtiene con ejecutarCadena
+// (camino secuencial, sin ventanas ni bloques). Cada hilo escribe solo su
+// propia posición de "resultados", así que no hace falta sincronizar más que
+// esperar a los hilos de cada tanda.
+int verificarConcurrencia(const char* carpeta, int total, int simultaneas) {
+    int cadena[5 * CAMPOS_PASO];
+    int nPasos = cadenaDelCaso(cadena, -1);
+    unsigned char* referencia = nullptr;
+    unsigned char* imRand = nullptr;
+    unsigned char* mask = nullptr;
+    unsigned char* S[2] = { nullptr, nullptr };
+    int semillas[2] = { 0, 0 };
+    int nPix[2] = { 0, 0 };
+    int ancho = 0, alto = 0, totalMaskBytes = 0;
+    if (!cargarCaso(carpeta, referencia, imRand, mask, S, semillas, nPix, ancho, alto,
+                    totalMaskBytes))
+        return -1;
+    int dataSize = ancho * alto * 3;
+    const unsigned char* ruidos[1] = { imRand };
+    int** perms = prepararPermutaciones(cadena, nPasos, ancho, alto);
+    ejecutarCadena(referencia, dataSize, ruidos, cadena, nPasos, totalMaskBytes, S,
+                   semillas, perms);
+    liberarPermutaciones(perms, nPasos);
+    liberarPixeles(imRand);
+    liberarPixeles(mask);
+    delete [] S[0];
+    delete [] S[1];
+
+    if (total < 1)
+        total = 1;
+    if (simultaneas < 1)
+        simultaneas = 1;
+    int* resultados = new int[total];
+    int* perfiles = new int[total * AJ_TOTAL];
+    for (int i = 0; i < total; ++i) {
+        // Núcleos, hilos internos y bloques distintos en cada decodificación
+        int* perfil = perfiles + i * AJ_TOTAL;
+        perfilPorDefecto(perfil);
+        perfil[AJ_VARIANTE] = varianteDisponible(i % 4) ? i % 4 : VAR_ESCALAR;
+        perfil[AJ_ROTACION] = (i / 4) % 2;
+        perfil[AJ_HILOS] = 1 + i % 3;
+        perfil[AJ_BLOQUE] = 4096 << (i % 5);
+    }
+    QThread** hilos = new QThread*[simultaneas];
+    for (int ini = 0; ini < total; ini += simultaneas) {
+        int n = simultaneas < total - ini ? simultaneas : total - ini;
+        for (int t = 0; t < n; ++t) {
+            int i = ini + t;
+            hilos[t] = QThread::create([=]() {
+                int w = 0, h = 0;
+                unsigned char* img = decodificarCaso(carpeta, cadena, nPasos,
+                                                     perfiles + i * AJ_TOTAL, w, h);
+                resultados[i] = img && w == ancho && h == alto &&
+                                memcmp(img, referencia, dataSize) == 0;
+                liberarPixeles(img);
+            });
+            hilos[t]->start();
+        }
+        for (int t = 0; t < n; ++t) {
+            hilos[t]->wait();
+            delete hilos[t];
+        }
+    }
+    int distintas = 0;
+    for (int i = 0; i < total; ++i)
+        if (!resultados[i])
+            ++distintas;
+    delete [] hilos;
+    delete [] perfiles;
+    delete [] resultados;
+    liberarPixeles(referencia);
+    return distintas;
+}
+
+// Etapas de un caso en procesarLote
+const int ETAPA_SIN_CARGAR = 0;
+const int ETAPA_CARGADO = 1;      // Listo para que un trabajador lo tome
+const int ETAPA_CALCULANDO = 2;
+const int ETAPA_POR_EXPORTAR = 3; // Calculado (o fallido), espera al hilo de E/S
+const int ETAPA_TERMINADO = 4;
+
+// -----------------------------------------------------------------------------
+// Función procesarLote: Cada caso es una máquina de estados (ETAPA_*) que
+// avanzan dos clases de hilos:
+// - El hilo que llama es el de entrada/salida: carga casos por adelantado
+//   (hasta EN_VUELO casos cargados sin exportar) y exporta los que llegan a
+//   ETAPA_POR_EXPORTAR. Así los trabajadores nunca esperan al disco. Sin nada
+//   que hacer, tanto el hilo de E/S como los trabajadores duermen en una
+//   condición hasta que otro hilo les avisa.
+// - Antes de cargar un caso se estima su memoria con las cabeceras; solo se
+//   admite si lo que está en vuelo más el caso cabe en el presupuesto (o si
+//   no hay nada en vuelo). Un caso que por sí solo no cabe no se carga: un
+//   trabajador lo procesa con decodificarPorBandas.
+// - Los trabajadores toman en orden los casos cargados. Un caso pequeño se
+//   decodifica en esa misma tarea. Uno grande, después de verificarse, se
+//   divide en trozos de TROZO bytes que se agregan a la cola del trabajador;
+//   los demás los roban cuando se quedan sin trabajo. Cada trozo evalúa la
+//   cadena con evaluarRangos desde la imagen original hacia un buffer de
+//   salida, así los trozos son independientes. El último en terminar pasa el
+//   caso a ETAPA_POR_EXPORTAR.
+// Una tarea de trozo es un entero de 64 bits: el caso en la parte alta y el
+// trozo en la baja. Cada cola es un deque de Chase-Lev: el dueño agrega y saca
+// por abajo sin bloqueos y los ladrones compiten por arriba con
+// compare_exchange.
+int procesarLote(const char* const* carpetas, int nCasos, int nHilos,
+                 long long presupuesto) {
+    const long long CAPACIDAD = 4096;   // Tareas por cola; si se llena, el trozo se ejecuta ahí
+    const int UMBRAL_TROCEO = 8 << 20;  // Casos desde este tamaño se dividen en trozos
+    const int TROZO = 2 << 20;
+    const int SUBBLOQUE = 256 << 10;    // Cada trozo se evalúa por partes del tamaño de L2
+    if (nHilos < 1)
+        nHilos = 1;
+    const int EN_VUELO = 2 * nHilos + 1;
+    const int BANDA = 4 << 20;
+    if (presupuesto <= 0) {
+        presupuesto = 2LL << 30;
+#ifdef __linux__
+        long long paginas = sysconf(_SC_PHYS_PAGES);
+        long long tamPagina = sysconf(_SC_PAGE_SIZE);
+        if (paginas > 0 && tamPagina > 0)
+            presupuesto = paginas * tamPagina / 2;
+#endif
+    }
+    int cadena[5 * CAMPOS_PASO];
+    int nPasos = cadenaDelCaso(cadena, -1);
+    bool hayPermutaciones = false;
+    for (int j = 0; j < nPasos; ++j)
+        if (esPermutacion(cadena[j * CAMPOS_PASO]))
+            hayPermutaciones = true;
+
+    // Estado de cada caso en arreglos paralelos indexados por caso
+    unsigned char** imgs = new unsigned char*[nCasos]();
+    unsigned char** ruidosCaso = new unsigned char*[nCasos]();
+    unsigned char** masks = new unsigned char*[nCasos]();
+    unsigned char** salidas = new unsigned char*[nCasos]();
+    unsigned char** Ss = new unsigned char*[2 * nCasos]();
+    int* semillas = new int[2 * nCasos]();
+    int* nPix = new int[2 * nCasos]();
+    int* anchos = new int[nCasos]();
+    int* altos = new int[nCasos]();
+    int* bytesMascara = new int[nCasos]();
+    int* correctos = new int[nCasos]();
+    int* exportados = new int[nCasos]();
+    int* porBandas = new int[nCasos]();
+    // Por qué falló un caso: FALLO_CARGA o el índice del paso de desenmascarado
+    // (-1 si no falló antes de exportar)
+    const int FALLO_CARGA = -2;
+    int* fallos = new int[nCasos];
+    for (int c = 0; c < nCasos; ++c)
+        fallos[c] = -1;
+    long long* estimados = new long long[nCasos]();
+    atomic<int>* etapas = new atomic<int>[nCasos]();
+    atomic<int>* trozosPendientes = new atomic<int>[nCasos]();
+    atomic<int> cargados(0);      // Los casos [0, cargados) ya pasaron por la carga
+    atomic<int> siguiente(0);     // Próximo caso cargado que tomará un trabajador
+    atomic<bool> fin(false);
+    // Los trabajadores sin tarea duermen en "espera". "avisos" cuenta los
+    // avisos de trabajo nuevo: un trabajador lo lee antes de buscar y solo
+    // duerme si no cambió, así no se pierde un aviso que llega mientras busca.
+    // El hilo de E/S duerme igual en "esperaEntrada" cuando no tiene nada que
+    // exportar ni puede cargar, hasta que un caso llega a ETAPA_POR_EXPORTAR
+    // (lo único que le da trabajo nuevo: exportar libera lugar para cargar).
+    QMutex mutexEspera;
+    QWaitCondition espera;
+    QWaitCondition esperaEntrada;
+    long long avisos = 0;
+    long long avisosEntrada = 0;
+
+    atomic<long long>* colas = new atomic<long long>[nHilos * CAPACIDAD]();
+    atomic<long long>* arriba = new atomic<long long>[nHilos]();
+    atomic<long long>* abajo = new atomic<long long>[nHilos]();
+
+    // Hay trabajo nuevo (trozos en una cola, un caso cargado o el fin del lote)
+    auto avisar = [&]() {
+        QMutexLocker bloqueo(&mutexEspera);
+        ++avisos;
+        espera.wakeAll();
+    };
+    // Un caso quedó listo para el hilo de E/S
+    auto pasarAExportar = [&](int c) {
+        etapas[c].store(ETAPA_POR_EXPORTAR, memory_order_release);
+        QMutexLocker bloqueo(&mutexEspera);
+        ++avisosEntrada;
+        esperaEntrada.wakeOne();
+    };
+
+    // Operaciones del deque: empujar y sacar solo las usa el dueño de la cola
+    auto empujar = [&](int w, long long tarea) {
+        long long b = abajo[w].load(memory_order_relaxed);
+        if (b - arriba[w].load(memory_order_acquire) >= CAPACIDAD)
+            return false;
+        colas[w * CAPACIDAD + b % CAPACIDAD].store(tarea, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        abajo[w].store(b + 1, memory_order_relaxed);
+        return true;
+    };
+    auto sacar = [&](int w) -> long long {
+        long long b = abajo[w].load(memory_order_relaxed) - 1;
+        abajo[w].store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        long long a = arriba[w].load(memory_order_relaxed);
+        if (a > b) {
+            abajo[w].store(b + 1, memory_order_relaxed);
+            return -1;
+        }
+        long long tarea = colas[w * CAPACIDAD + b % CAPACIDAD].load(memory_order_relaxed);
+        if (a == b) {
+            // Último elemento: se compite con los ladrones
+            if (!arriba[w].compare_exchange_strong(a, a + 1, memory_order_seq_cst,
+                                                   memory_order_relaxed))
+                tarea = -1;
+            abajo[w].store(b + 1, memory_order_relaxed);
+        }
+        return tarea;
+    };
+    auto robar = [&](int v) -> long long {
+        long long a = arriba[v].load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        long long b = abajo[v].load(memory_order_acquire);
+        if (a >= b)
+            return -1;
+        long long tarea = colas[v * CAPACIDAD + a % CAPACIDAD].load(memory_order_relaxed);
+        if (!arriba[v].compare_exchange_strong(a, a + 1, memory_order_seq_cst,
+                                               memory_order_relaxed))
+            return -1;
+        return tarea;
+    };
+
+    auto ejecutarTrozo = [&](int c, int i) {
+        int dataSize = anchos[c] * altos[c] * 3;
+        const unsigned char* ruidos[1] = { ruidosCaso[c] };
+        int finTrozo = (i + 1) * TROZO < dataSize ? (i + 1) * TROZO : dataSize;
+        for (int ini = i * TROZO; ini < finTrozo; ini += SUBBLOQUE) {
+            int rango[2] = { ini, ini + SUBBLOQUE < finTrozo ? ini + SUBBLOQUE : finTrozo };
+            evaluarRangos(imgs[c], dataSize, ruidos, cadena, nPasos, bytesMascara[c],
+                          Ss + 2 * c, semillas + 2 * c, nullptr, rango, 1, salidas[c] + ini);
+        }
+        if (trozosPendientes[c].fetch_sub(1) == 1) {
+            correctos[c] = 1;
+            pasarAExportar(c);
+        }
+    };
+    // Etapa de cálculo de un caso ya cargado
+    auto calcularCaso = [&](int w, int c) {
+        if (porBandas[c]) {
+            correctos[c] = decodificarPorBandas(carpetas[c], cadena, nPasos, BANDA);
+            pasarAExportar(c);
+            return;
+        }
+        int dataSize = anchos[c] * altos[c] * 3;
+        const unsigned char* ruidos[1] = { ruidosCaso[c] };
+        if (dataSize < UMBRAL_TROCEO || hayPermutaciones) {
+            // Caso entero en esta tarea, con un solo hilo interno
+            int perfil[AJ_TOTAL];
+            perfilPorDefecto(perfil);
+            fallos[c] = decodificarEnMemoria(imgs[c], anchos[c], altos[c], ruidos, cadena,
+                                             nPasos, bytesMascara[c], Ss + 2 * c,
+                                             semillas + 2 * c, nPix + 2 * c, perfil);
+            correctos[c] = fallos[c] < 0;
+            pasarAExportar(c);
+            return;
+        }
+        fallos[c] = verificarVentanas(imgs[c], dataSize, ruidos, cadena, nPasos, bytesMascara[c],
+                                      Ss + 2 * c, semillas + 2 * c, nPix + 2 * c, nullptr);
+        if (fallos[c] >= 0) {
+            pasarAExportar(c);
+            return;
+        }
+        salidas[c] = reservarPixeles(dataSize);
+        int nTrozos = (dataSize + TROZO - 1) / TROZO;
+        trozosPendientes[c].store(nTrozos);
+        for (int i = 0; i < nTrozos; ++i)
+            if (!empujar(w, (static_cast<long long>(c) << 32) | i))
+                ejecutarTrozo(c, i);
+        avisar();
+    };
+    // Toma el próximo caso cargado, si lo hay. Retorna su índice o -1.
+    auto tomarCaso = [&]() {
+        int c = siguiente.load();
+        while (c < cargados.load(memory_order_acquire)) {
+            if (siguiente.compare_exchange_weak(c, c + 1)) {
+                int esperado = ETAPA_CARGADO;
+                if (etapas[c].compare_exchange_strong(esperado, ETAPA_CALCULANDO))
+                    return c;
+                c = siguiente.load(); // Falló la carga; se sigue con el próximo
+            }
+        }
+        return -1;
+    };
+
+    QThread** hilos = new QThread*[nHilos];
+    for (int w = 0; w < nHilos; ++w) {
+        hilos[w] = QThread::create([&, w]() {
+            unsigned int azar = 2654435761u * (w + 1);
+            while (!fin.load()) {
+                long long vistos = 0;
+                {
+                    QMutexLocker bloqueo(&mutexEspera);
+                    vistos = avisos;
+                }
+                // Primero los trozos pendientes (propios o robados), que liberan
+                // memoria antes; después, un caso nuevo
+                long long tarea = sacar(w);
+                for (int intento = 0; tarea < 0 && intento < 2 * nHilos; ++intento) {
+                    azar ^= azar << 13;
+                    azar ^= azar >> 17;
+                    azar ^= azar << 5;
+                    int v = static_cast<int>(azar % nHilos);
+                    if (v != w)
+                        tarea = robar(v);
+                }
+                if (tarea >= 0) {
+                    ejecutarTrozo(static_cast<int>(tarea >> 32),
+                                  static_cast<int>(tarea & 0xFFFFFFFFLL));
+                    continue;
+                }
+                int c = tomarCaso();
+                if (c >= 0) {
+                    calcularCaso(w, c);
+                    continue;
+                }
+                QMutexLocker bloqueo(&mutexEspera);
+                if (avisos == vistos && !fin.load())
+                    espera.wait(&mutexEspera);
+            }
+        });
+        hilos[w]->start();
+    }
+
+    // Memoria estimada de cada caso (las cabeceras se leen antes de empezar)
+    for (int c = 0; c < nCasos; ++c) {
+        long long bytesImagen = 0;
+        estimados[c] = estimarMemoriaCaso(carpetas[c], bytesImagen);
+        if (estimados[c] > 0 && bytesImagen >= UMBRAL_TROCEO)
+            estimados[c] += bytesImagen; // Buffer de salida de los trozos
+        if (estimados[c] > presupuesto) {
+            porBandas[c] = 1;
+            estimados[c] = 3LL * BANDA;
+            cout << carpetas[c] << ": no cabe en " << (presupuesto >> 20)
+                 << " MiB, se procesa por bandas." << endl;
+        }
+    }
+
+    // Hilo de entrada/salida
+    int cargadosLocal = 0;
+    int terminados = 0;
+    long long enUso = 0; // Memoria estimada de los casos en vuelo
+    int primero = 0; // Primer caso que no está terminado
+    while (terminados < nCasos) {
+        long long vistosEntrada = 0;
+        {
+            QMutexLocker bloqueo(&mutexEspera);
+            vistosEntrada = avisosEntrada;
+        }
+        bool trabajo = false;
+        // Exportar primero: libera la memoria de los casos terminados
+        for (int c = primero; c < cargadosLocal; ++c) {
+            if (etapas[c].load(memory_order_acquire) != ETAPA_POR_EXPORTAR)
+                continue;
+            unsigned char* resultado = salidas[c] ? salidas[c] : imgs[c];
+            string ruta = string(carpetas[c]) + "/I_D.bmp";
+            if (porBandas[c])
+                exportados[c] = correctos[c]; // Ya escribió I_D.bmp
+            else
+                exportados[c] = correctos[c] && exportImage(resultado, anchos[c], altos[c],
+                                                            QString(ruta.c_str()));
+            enUso -= estimados[c];
+            liberarPixeles(imgs[c]);
+            liberarPixeles(ruidosCaso[c]);
+            liberarPixeles(masks[c]);
+            liberarPixeles(salidas[c]);
+            delete [] Ss[2 * c];
+            delete [] Ss[2 * c + 1];
+            etapas[c].store(ETAPA_TERMINADO);
+            ++terminados;
+            trabajo = true;
+        }
+        while (primero < cargadosLocal && etapas[primero].load() == ETAPA_TERMINADO)
+            ++primero;
+        // Cargar el próximo caso si hay lugar en la cantidad y en la memoria
+        int c = cargadosLocal;
+        if (c < nCasos && c - terminados < EN_VUELO &&
+            (c == terminados || enUso + estimados[c] <= presupuesto)) {
+            if (porBandas[c]) {
+                enUso += estimados[c];
+                etapas[c].store(ETAPA_CARGADO, memory_order_release);
+            } else if (cargarCaso(carpetas[c], imgs[c], ruidosCaso[c], masks[c], Ss + 2 * c,
+                                  semillas + 2 * c, nPix + 2 * c, anchos[c], altos[c],
+                                  bytesMascara[c])) {
+                enUso += estimados[c];
+                etapas[c].store(ETAPA_CARGADO, memory_order_release);
+            } else {
+                fallos[c] = FALLO_CARGA;
+                etapas[c].store(ETAPA_TERMINADO);
+                ++terminados;
+            }
+            cargados.store(++cargadosLocal, memory_order_release);
+            avisar();
+            trabajo = true;
+        }
+        if (!trabajo) {
+            QMutexLocker bloqueo(&mutexEspera);
+            if (avisosEntrada == vistosEntrada)
+                esperaEntrada.wait(&mutexEspera);
+        }
+    }
+    fin.store(true);
+    avisar();
+    for (int w = 0; w < nHilos; ++w) {
+        hilos[w]->wait();
+        delete hilos[w];
+    }
+
+    int fallidos = 0;
+    for (int c = 0; c < nCasos; ++c) {
+        cout << carpetas[c] << ": ";
+        if (exportados[c])
+            cout << "I_D.bmp exportada";
+        else if (fallos[c] == FALLO_CARGA)
+            cout << "error, no se pudieron cargar los archivos del caso";
+        else if (fallos[c] >= 0)
+            cout << "error, S" << cadena[fallos[c] * CAMPOS_PASO + 1] + 1
+                 << ": La correccion no es valida";
+        else if (porBandas[c])
+            cout << "error en el modo por bandas (ver mensajes anteriores)";
+        else
+            cout << "error al exportar I_D.bmp";
+        cout << endl;
+        if (!exportados[c])
+            ++fallidos;
+    }
+    delete [] hilos;
+    delete [] colas;
+    delete [] arriba;
+    delete [] abajo;
+    delete [] trozosPendientes;
+    delete [] etapas;
+    delete [] estimados;
+    delete [] fallos;
+    delete [] porBandas;
+    delete [] exportados;
+    delete [] correctos;
+    delete [] bytesMascara;
+    delete [] altos;
+    delete [] anchos;
+    delete [] nPix;
+    delete [] semillas;
+    delete [] Ss;
+    delete [] salidas;
+    delete [] masks;
+    delete [] ruidosCaso;
+    delete [] imgs;
+    return fallidos;
+}
+
+// -----------------------------------------------------------------------------
+// Función estimarMemoriaCaso: Imagen y ruido ocupan ancho * alto * 3 bytes
+// cada uno y la máscara igual con sus dimensiones. Las tres se cargan una tras
+// otra, así que al pico se suma la mayor memoria temporal de una carga: la
+// tira de cargarBmpNativo, o para un BMP que no es de 24 bits sin compresión
+// la QImage (cota de 4 bytes por píxel) y su copia RGB888. Para S se usa una
+// cota: cada valor ocupa al menos 2 caracteres en el archivo ("0 ") y 1 byte
+// en memoria (el residuo), así que S ocupa a lo sumo la mitad del archivo.
+long long estimarMemoriaCaso(const char* carpeta, long long &bytesImagen) {
+    string dir = string(carpeta) + "/";
+    const char* imagenes[] = { "P3.bmp", "I_M.bmp", "M.bmp" };
+    long long total = 0;
+    long long temporal = TIRA_BMP;
+    bytesImagen = 0;
+    for (int k = 0; k < 3; ++k) {
+        int ancho = 0, alto = 0, bits = 0, compresion = 0, inicio = 0;
+        long long tam = 0;
+        if (!leerCabeceraBmp((dir + imagenes[k]).c_str(), ancho, alto, bits, compresion,
+                             inicio, tam)) {
+            if (k < 2)
+                return -1;
+            continue;
+        }
+        long long pixeles = static_cast<long long>(ancho) * (alto < 0 ? -alto : alto);
+        if (k == 0)
+            bytesImagen = 3 * pixeles;
+        total += 3 * pixeles;
+        if ((bits != 24 || compresion != 0) && 7 * pixeles > temporal)
+            temporal = 7 * pixeles;
+    }
+    total += temporal;
+    const char* textos[] = { "M1.txt", "M2.txt" };
+    for (int i = 0; i < 2; ++i) {
+        ifstream f((dir + textos[i]).c_str(), ios::binary | ios::ate);
+        if (f)
+            total += static_cast<long long>(f.tellg()) / 2;
+    }
+    return total;
+}
+
+static void escribirLE32(unsigned char* p, unsigned int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+// Lee las filas [y0, y0 + n) (de arriba hacia abajo) de un BMP de 24 bits y
+// las deja en RGB en "destino". "fila" es un buffer de "paso" bytes.
+static bool leerFilasBmp(ifstream &f, int inicio, int ancho, int alto, bool abajoArriba,
+                         int y0, int n, unsigned char* fila, unsigned char* destino) {
+    int paso = (ancho * 3 + 3) & ~3;
+    for (int y = y0; y < y0 + n; ++y) {
+        long long filaArchivo = abajoArriba ? alto - 1 - y : y;
+        f.seekg(inicio + filaArchivo * paso);
+        f.read(reinterpret_cast<char*>(fila), paso);
+        if (!f)
+            return false;
+        unsigned char* out = destino + static_cast<long long>(y - y0) * ancho * 3;
+        for (int i = 0; i < ancho * 3; i += 3) {
+            out[i] = fila[i + 2];
+            out[i + 1] = fila[i + 1];
+            out[i + 2] = fila[i];
+        }
+    }
+    return true;
+}
+
+// Aplica los pasos [0, hasta) de la cadena al tramo [ini, ini + len) de la
+// imagen, ya leído en "datos" junto con el mismo tramo del ruido. Un
+// desenmascarado copia los residuos en la intersección de su ventana con el
+// tramo. Solo sirve para cadenas sin permutaciones ni ruido desplazado.
+static void aplicarPasosTramo(unsigned char* datos, const unsigned char* ruido, int ini, int len,
+                              const int* cadena, int hasta, unsigned char* const* S,
+                              const int* semillas, int totalMaskBytes, int dataSize) {
+    for (int j = 0; j < hasta; ++j) {
+        const int* p = cadena + j * CAMPOS_PASO;
+        if (p[0] == OP_XOR_RUIDO) {
+            for (int i = 0; i < len; ++i)
+                datos[i] ^= ruido[i];
+        } else if (p[0] == OP_DESENMASCARAR) {
+            int sp = semillas[p[1]];
+            int a = sp > ini ? sp : ini;
+            int b = sp + totalMaskBytes < ini + len ? sp + totalMaskBytes : ini + len;
+            if (b > a)
+                memcpy(datos + (a - ini), S[p[1]] + (a - sp), b - a);
+        } else {
+            aplicarPaso(datos, ini, len, nullptr, dataSize, p);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Función decodificarPorBandas: Como la cadena es local al byte, cada banda
+// de filas se puede decodificar sola. Antes de crear I_D.bmp se leen solo las
+// filas que cubren cada ventana de enmascaramiento y se verifica la ventana
+// completa, como en verificarVentanas: un caso inválido no escribe nada. Las
+// bandas se recorren después de abajo hacia arriba para que las filas de
+// I_D.bmp (que se guarda de abajo hacia arriba) se escriban en orden.
+bool decodificarPorBandas(const char* carpeta, const int* cadena, int nPasos, int bytesBanda) {
+    for (int j = 0; j < nPasos; ++j) {
+        const int* paso = cadena + j * CAMPOS_PASO;
+        if (esPermutacion(paso[0]) ||
+            (paso[0] == OP_XOR_RUIDO && (paso[1] != 0 || paso[2] != 0))) {
+            cerr << carpeta << ": la cadena no se puede aplicar por bandas." << endl;
+            return false;
+        }
+    }
+    string dir = string(carpeta) + "/";
+    int ancho = 0, alto = 0, bits = 0, compresion = 0, inicio = 0;
+    int anchoR = 0, altoR = 0, bitsR = 0, compresionR = 0, inicioR = 0;
+    long long tam = 0, tamR = 0;
+    if (!leerCabeceraBmp((dir + "P3.bmp").c_str(), ancho, alto, bits, compresion, inicio, tam) ||
+        !leerCabeceraBmp((dir + "I_M.bmp").c_str(), anchoR, altoR, bitsR, compresionR,
+                         inicioR, tamR) ||
+        bits != 24 || compresion != 0 || bitsR != 24 || compresionR != 0) {
+        cerr << carpeta << ": el modo por bandas requiere P3.bmp e I_M.bmp de 24 bits." << endl;
+        return false;
+    }
+    bool abajoArriba = alto > 0, abajoArribaR = altoR > 0;
+    alto = alto < 0 ? -alto : alto;
+    altoR = altoR < 0 ? -altoR : altoR;
+    int paso = (ancho * 3 + 3) & ~3;
+    if (ancho != anchoR || alto != altoR || ancho <= 0 || alto <= 0 ||
+        tam < inicio + static_cast<long long>(paso) * alto ||
+        tamR < inicioR + static_cast<long long>(paso) * alto) {
+        cerr << carpeta << ": P3.bmp e I_M.bmp truncados o de distinto tamano." << endl;
+        return false;
+    }
+    long long dataSize = 3LL * ancho * alto;
+
+    // Máscara y prefijo usado de los archivos de enmascaramiento (son pequeños)
+    int mi = 0, mj = 0;
+    unsigned char* mask = loadPixels(QString((dir + "M.bmp").c_str()), mi, mj);
+    int semillas[2] = { 0, 0 }, nPix[2] = { 0, 0 };
+    unsigned char* S[2] = { nullptr, nullptr };
+    if (mask)
+        S[0] = loadSeedMasking((dir + "M1.txt").c_str(), semillas[0], nPix[0], mask,
+                               mi * mj * 3, false);
+    if (S[0])
+        S[1] = loadSeedMasking((dir + "M2.txt").c_str(), semillas[1], nPix[1], mask,
+                               mi * mj * 3, false);
+    int totalMaskBytes = mi * mj * 3;
+    bool bien = S[1] != nullptr;
+    for (int m = 0; m < 2 && bien; ++m)
+        if (nPix[m] * 3 < totalMaskBytes || semillas[m] < 0 ||
+            semillas[m] + static_cast<long long>(totalMaskBytes) > dataSize)
+            bien = false;
+    ifstream fImg((dir + "P3.bmp").c_str(), ios::binary);
+    ifstream fRuido((dir + "I_M.bmp").c_str(), ios::binary);
+    unsigned char* fila = new unsigned char[paso];
+
+    // Verificación de las ventanas antes de cualquier banda
+    int bytesFila = ancho * 3;
+    int fallo = -1;
+    for (int j = 0; j < nPasos && bien && fallo < 0; ++j) {
+        const int* p = cadena + j * CAMPOS_PASO;
+        if (p[0] != OP_DESENMASCARAR)
+            continue;
+        int sp = semillas[p[1]];
+        int y0 = sp / bytesFila;
+        int n = (sp + totalMaskBytes - 1) / bytesFila - y0 + 1;
+        unsigned char* filasImg = new unsigned char[static_cast<long long>(n) * bytesFila];
+        unsigned char* filasRuido = new unsigned char[static_cast<long long>(n) * bytesFila];
+        if (leerFilasBmp(fImg, inicio, ancho, alto, abajoArriba, y0, n, fila, filasImg) &&
+            leerFilasBmp(fRuido, inicioR, ancho, alto, abajoArribaR, y0, n, fila, filasRuido)) {
+            int desde = sp - y0 * bytesFila;
+            unsigned char* ventana = filasImg + desde;
+            aplicarPasosTramo(ventana, filasRuido + desde, sp, totalMaskBytes, cadena, j, S,
+                              semillas, totalMaskBytes, static_cast<int>(dataSize));
+            if (memcmp(ventana, S[p[1]], totalMaskBytes) != 0) {
+                fallo = j;
+                int diag[DIAG_TOTAL] = { 0 };
+                int* porFila = new int[mj]();
+                compararVentana(ventana, S[p[1]], totalMaskBytes, sp, 0, mi * 3, diag, porFila);
+                cout << carpeta << ": S" << p[1] + 1 << ": La correccion no es valida." << endl;
+                informarDiagnostico(diag, porFila, mj);
+                delete [] porFila;
+            }
+        } else {
+            bien = false;
+        }
+        delete [] filasRuido;
+        delete [] filasImg;
+    }
+    bien = bien && fallo < 0;
+
+    string rutaSalida = dir + "I_D.bmp";
+    ofstream fOut;
+    if (bien) {
+        fOut.open(rutaSalida.c_str(), ios::binary);
+        unsigned char cab[54];
+        memset(cab, 0, sizeof(cab));
+        cab[0] = 'B';
+        cab[1] = 'M';
+        escribirLE32(cab + 2, static_cast<unsigned int>(54 + static_cast<long long>(paso) * alto));
+        escribirLE32(cab + 10, 54);
+        escribirLE32(cab + 14, 40);
+        escribirLE32(cab + 18, ancho);
+        escribirLE32(cab + 22, alto);
+        cab[26] = 1;
+        cab[28] = 24;
+        escribirLE32(cab + 34, static_cast<unsigned int>(static_cast<long long>(paso) * alto));
+        escribirLE32(cab + 38, 2835);
+        escribirLE32(cab + 42, 2835);
+        fOut.write(reinterpret_cast<const char*>(cab), 54);
+        bien = static_cast<bool>(fOut);
+    }
+
+    int filasBanda = bytesBanda / (ancho * 3) > 0 ? bytesBanda / (ancho * 3) : 1;
+    unsigned char* banda = new unsigned char[static_cast<long long>(filasBanda) * ancho * 3];
+    unsigned char* ruido = new unsigned char[static_cast<long long>(filasBanda) * ancho * 3];
+    for (int fin = alto; fin > 0 && bien; fin -= filasBanda) {
+        int y0 = fin - filasBanda > 0 ? fin - filasBanda : 0;
+        int n = fin - y0;
+        if (!leerFilasBmp(fImg, inicio, ancho, alto, abajoArriba, y0, n, fila, banda) ||
+            !leerFilasBmp(fRuido, inicioR, ancho, alto, abajoArribaR, y0, n, fila, ruido)) {
+            bien = false;
+            break;
+        }
+        aplicarPasosTramo(banda, ruido, y0 * bytesFila, n * bytesFila, cadena, nPasos, S,
+                          semillas, totalMaskBytes, static_cast<int>(dataSize));
+        // Filas de la banda de abajo hacia arriba, en BGR y con relleno
+        memset(fila, 0, paso);
+        for (int y = fin - 1; y >= y0; --y) {
+            const unsigned char* in = banda + static_cast<long long>(y - y0) * ancho * 3;
+            for (int i = 0; i < ancho * 3; i += 3) {
+                fila[i] = in[i + 2];
+                fila[i + 1] = in[i + 1];
+                fila[i + 2] = in[i];
+            }
+            fOut.write(reinterpret_cast<const char*>(fila), paso);
+        }
+    }
+    bien = bien && static_cast<bool>(fOut);
+    if (fOut.is_open()) {
+        fOut.close();
+        if (!bien)
+            remove(rutaSalida.c_str());
+    }
+    delete [] fila;
+    delete [] ruido;
+    delete [] banda;
+    liberarPixeles(mask);
+    delete [] S[0];
+    delete [] S[1];
+    return bien;
+}
+
+#ifdef DESAFIO_X86
+// Saltos de línea en un bloque: se comparan 16 o 32 bytes a la vez con '\n'
+// y la máscara de la comparación se suma con popcount.
+static long long contarSaltosSse2(const unsigned char* d, long long len) {
+    __m128i salto = _mm_set1_epi8('\n');
+    long long n = 0, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, salto)));
+    }
+    for (; i < len; ++i)
+        n += d[i] == '\n';
+    return n;
+}
+
+__attribute__((target("avx2,popcnt")))
+static long long contarSaltosAvx2(const unsigned char* d, long long len) {
+    __m256i salto = _mm256_set1_epi8('\n');
+    long long n = 0, i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        n += __builtin_popcount(static_cast<unsigned int>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, salto))));
+    }
+    for (; i < len; ++i)
+        n += d[i] == '\n';
+    return n;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// Función contarLineas: Lee el archivo por partes de 1 MiB.
+long long contarLineas(const char* ruta, long long &primero) {
+    ifstream f(ruta, ios::binary);
+    primero = -1;
+    if (!f)
+        return -1;
+    const int PARTE = 1 << 20;
+    unsigned char* buf = new unsigned char[PARTE];
+    long long lineas = 0;
+    bool inicio = true;
+    unsigned char ultimo = '\n';
+#ifdef DESAFIO_X86
+    bool avx2 = varianteDisponible(VAR_AVX2);
+#endif
+    while (f) {
+        f.read(reinterpret_cast<char*>(buf), PARTE);
+        long long leidos = f.gcount();
+        if (leidos <= 0)
+            break;
+        if (inicio) {
+            // Entero de la primera línea (la semilla)
+            long long v = 0;
+            int i = 0;
+            while (i < leidos && (buf[i] == ' ' || buf[i] == '\r' || buf[i] == '\t'))
+                ++i;
+            if (i < leidos && buf[i] >= '0' && buf[i] <= '9') {
+                for (; i < leidos && buf[i] >= '0' && buf[i] <= '9'; ++i)
+                    v = v * 10 + (buf[i] - '0');
+                primero = v;
+            }
+            inicio = false;
+        }
+#ifdef DESAFIO_X86
+        lineas += avx2 ? contarSaltosAvx2(buf, leidos) : contarSaltosSse2(buf, leidos);
+#else
+        for (long long i = 0; i < leidos; ++i)
+            lineas += buf[i] == '\n';
+#endif
+        ultimo = buf[leidos - 1];
+    }
+    if (ultimo != '\n')
+        ++lineas;
+    delete [] buf;
+    return lineas;
+}
+
+// -----------------------------------------------------------------------------
+// Función sondearCaso: Solo se leen los 54 bytes de cabecera de cada BMP; de
+// los M*.txt se cuentan las líneas (una por tripleta más la de la semilla).
+void sondearCaso(const char* carpeta, int* sonda) {
+    for (int i = 0; i < SONDA_TOTAL; ++i)
+        sonda[i] = -1;
+    string dir = string(carpeta) + "/";
+    const char* imagenes[] = { "P3.bmp", "I_M.bmp", "M.bmp" };
+    for (int k = 0; k < 3; ++k) {
+        int ancho = 0, alto = 0, bits = 0, compresion = 0, inicio = 0;
+        long long tam = 0;
+        if (!leerCabeceraBmp((dir + imagenes[k]).c_str(), ancho, alto, bits, compresion,
+                             inicio, tam))
+            continue;
+        sonda[3 * k] = ancho;
+        sonda[3 * k + 1] = alto < 0 ? -alto : alto;
+        sonda[3 * k + 2] = bits;
+    }
+    const char* textos[] = { "M1.txt", "M2.txt" };
+    for (int m = 0; m < 2; ++m) {
+        long long semilla = -1;
+        long long lineas = contarLineas((dir + textos[m]).c_str(), semilla);
+        if (lineas < 0)
+            continue;
+        sonda[SONDA_SEMILLA_1 + 2 * m] = static_cast<int>(semilla);
+        sonda[SONDA_TRIPLETAS_1 + 2 * m] = static_cast<int>(lineas > 0 ? lineas - 1 : 0);
+    }
+}